@@ -1,52 +1,109 @@
+#include "../problems/cpp/producerConsumer/boundedQueue.hpp"
+#include "../problems/cpp/producerConsumer/threadPool.hpp"
+#include "../problems/cpp/producerConsumer/pipeline.hpp"
 #include <iostream>
-#include <queue>
+#include <iomanip>
+#include <memory>
+#include <string>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
+#include <chrono>
+#include <vector>
 
-std::mutex mtx; // Mutex for synchronization
-std::condition_variable cond_var; // Condition variable for producer-consumer signaling
-std::queue<int> buffer;
 const unsigned int MAX_BUFFER_SIZE = 10; // Max size of buffer
+const int ITEM_COUNT = 20;
+const int BATCH_SIZE = 5; // items handed over per pushN
+const int RECORD_COUNT = 2000;
 
-void producer(int val) {
-    std::unique_lock<std::mutex> lock(mtx); // Lock the mutex
-    cond_var.wait(lock, [] { return buffer.size() < MAX_BUFFER_SIZE; }); // Wait until there's space in buffer
-    buffer.push(val);
-    std::cout << "Producing " << val << std::endl;
-    std::cout << "Buffer size after producing: " << buffer.size() << std::endl;
-    lock.unlock(); // Unlock the mutex
-    cond_var.notify_one(); // Notify one waiting thread
-}
-
-void consumer() {
-    std::unique_lock<std::mutex> lock(mtx);
-    cond_var.wait(lock, [] { return buffer.size() > 0; }); // Wait unitl there's something in the buffer
-
-    int val = buffer.front(); // Get the front val in the buffer
-    buffer.pop(); // Remove val from buffer
-    std::cout << "Consuming " << val << std::endl;
-    std::cout << "Buffer size after consuming: " << buffer.size() << std::endl;
-    lock.unlock();
-    cond_var.notify_one();
-}
+static_assert(BoundedQueueInterface<BoundedQueue<std::unique_ptr<int>, QueueKind::MUTEX>, std::unique_ptr<int>>);
+static_assert(BoundedQueueInterface<BoundedQueue<std::unique_ptr<int>, QueueKind::SPSC>, std::unique_ptr<int>>);
+static_assert(BoundedQueueInterface<BoundedQueue<std::unique_ptr<int>, QueueKind::MPMC>, std::unique_ptr<int>>);
 
-int main() {
-    std::thread producerThread([] {
-        for (int i = 0; i < 20; i++) {
-            producer(i); // Produces 20 items
+// Producer and consumer run on their own threads; any BoundedQueue works
+template <typename Queue>
+void runProducerConsumer(const std::string& label, Queue& buffer) {
+    std::thread producerThread([&buffer, &label] {
+        for (int i = 0; i < ITEM_COUNT; i += BATCH_SIZE) {
+            std::vector<std::unique_ptr<int>> batch;
+            for (int j = i; j < i + BATCH_SIZE; j++) {
+                batch.push_back(std::make_unique<int>(j));
+            }
+            buffer.pushN(batch); // Wait until the whole batch fits, one wakeup per batch
+            std::cout << label << " produced " << i << ".." << i + BATCH_SIZE - 1 << std::endl;
         }
     });
 
-    // Delay 1 second before starting consumer thread to make sure the buffer would be full with data
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // Delay before starting consumer thread to make sure the buffer would be full with data
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::cout << label << " buffer size before consuming: " << buffer.size() << std::endl;
 
-    std::thread consumerThread([] {
-        for(int i = 0; i < 20; i++) {
-            consumer(); // Consume 20 items
+    std::thread consumerThread([&buffer, &label] {
+        std::vector<std::unique_ptr<int>> vals;
+        for (int consumed = 0; consumed < ITEM_COUNT;) {
+            vals.clear();
+            consumed += buffer.popN(vals, MAX_BUFFER_SIZE); // Take everything available at once
+            for (const std::unique_ptr<int>& val : vals) {
+                std::cout << label << " consuming " << *val << std::endl; // printed outside the queue's lock
+            }
         }
     });
     producerThread.join(); // Wait for producer thread to finish
     consumerThread.join(); // Wait for consumer thread to finish
+}
+
+int main() {
+    BoundedQueue<std::unique_ptr<int>, QueueKind::MUTEX> lockedBuffer(MAX_BUFFER_SIZE);
+    runProducerConsumer("mutex", lockedBuffer);
+
+    // The ring buffers round their capacity up to a power of two
+    BoundedQueue<std::unique_ptr<int>, QueueKind::SPSC> spscBuffer(MAX_BUFFER_SIZE);
+    runProducerConsumer("spsc", spscBuffer);
+
+    BoundedQueue<std::unique_ptr<int>, QueueKind::MPMC> mpmcBuffer(MAX_BUFFER_SIZE);
+    runProducerConsumer("mpmc", mpmcBuffer);
+
+    // Work-stealing pool: futures for single tasks, parallelFor for ranges
+    ThreadPool pool(4);
+    std::future<int> answer = pool.submit([] { return 6 * 7; });
+    std::vector<long long> squares(1000);
+    pool.parallelFor(0, (int)squares.size(), [&squares](int i) { squares[i] = (long long)i * i; });
+    long long sum = 0;
+    for (long long square : squares) {
+        sum += square;
+    }
+    std::cout << "pool answer " << answer.get() << ", sum of squares " << sum << std::endl;
+
+    // Pipeline: parse -> enrich -> aggregate over bounded queues; a full queue stalls the stage before it
+    struct Record {
+        int key;
+        long long value;
+    };
+    int next = 0;
+    long long total = 0;
+    std::unique_ptr<Pipeline> pipeline = PipelineBuilder<std::string>::source("read",
+        [&next]() -> std::optional<std::string> {
+            if (next == RECORD_COUNT) return std::nullopt;
+            int i = next++;
+            return std::to_string(i % 10) + "," + std::to_string(i);
+        }, 64)
+        .stage("parse", 2, Ordering::RELAXED, [](std::string line) {
+            std::size_t comma = line.find(',');
+            return Record{std::stoi(line.substr(0, comma)), std::stoll(line.substr(comma + 1))};
+        })
+        .stage("enrich", 4, Ordering::PRESERVED, [](Record record) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50)); // stands in for a lookup
+            record.value *= 2;
+            return record;
+        })
+        .sink("aggregate", 1, [&total](Record record) { total += record.value; });
+    pipeline->run();
+
+    std::cout << "pipeline total " << total << std::endl;
+    for (const StageStats& stage : pipeline->getStats()) {
+        std::cout << std::setw(10) << stage.name << " workers " << stage.workers << " items " << stage.items
+                  << " busy " << std::setprecision(3) << stage.utilization * 100 << "%"
+                  << " starved " << stage.inputWaitSeconds << "s blocked " << stage.outputBlockedSeconds << "s"
+                  << std::endl;
+    }
+    std::cout << "bottleneck: " << pipeline->getBottleneck() << std::endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,163 @@
+#ifndef AGGREGATETABLE_HPP
+#define AGGREGATETABLE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+constexpr std::size_t DENSE_KEY_LIMIT = 1 << 16; // widest key range kept in the dense array
+constexpr std::size_t MIN_HASH_CAPACITY = 64;
+
+// Everything known about one key, in one 32-byte slot: two slots share a cache
+// line and an update touches a single line. count == 0 marks an empty slot.
+struct alignas(32) KeyAggregate {
+    std::uint64_t count = 0;
+    std::int64_t sum = 0;
+    int key = 0;
+    int min = std::numeric_limits<int>::max();
+    int max = std::numeric_limits<int>::min();
+
+    void add(int value) {
+        count++;
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+
+    void merge(const KeyAggregate& other) {
+        count += other.count;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+};
+
+// Count, 64-bit sum, min and max per integer key. While every key seen fits in a
+// DENSE_KEY_LIMIT-wide range the slot is found by subtraction; after that the
+// table switches to open addressing with linear probing over the same slots.
+class AggregateTable {
+private:
+    std::vector<KeyAggregate> slots;
+    std::size_t used = 0;
+    bool dense = true;
+    int denseBase = 0; // key of slots[0] in dense mode
+    int hashShift = 64;
+
+    std::size_t hashIndex(int key) const {
+        return (std::size_t)(((std::uint64_t)(std::uint32_t)key * 0x9E3779B97F4A7C15ull) >> hashShift);
+    }
+
+    KeyAggregate& hashSlot(int key) {
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t index = hashIndex(key);; index = (index + 1) & mask) {
+            KeyAggregate& slot = slots[index];
+            if (slot.count == 0) {
+                if ((used + 1) * 8 > slots.size() * 7) { // keep the load under 7/8
+                    rehash(slots.size() * 2);
+                    return hashSlot(key);
+                }
+                slot.key = key;
+                used++;
+                return slot;
+            }
+            if (slot.key == key) return slot;
+        }
+    }
+
+    void rehash(std::size_t capacity) {
+        std::vector<KeyAggregate> old;
+        old.swap(slots);
+        slots.assign(capacity, KeyAggregate());
+        hashShift = 64 - __builtin_ctzll(capacity);
+        used = 0;
+        dense = false;
+        for (const KeyAggregate& entry : old) {
+            if (entry.count > 0) hashSlot(entry.key).merge(entry);
+        }
+    }
+
+    // Widens the dense range to take key, or gives up on dense mode
+    void growDense(int key) {
+        std::int64_t low = slots.empty() ? key : std::min<std::int64_t>(denseBase, key);
+        std::int64_t high = slots.empty() ? key : std::max<std::int64_t>(denseBase + (std::int64_t)slots.size() - 1, key);
+        if (high - low + 1 > (std::int64_t)DENSE_KEY_LIMIT) {
+            std::size_t capacity = MIN_HASH_CAPACITY;
+            while (capacity * 7 < (used + 1) * 8) capacity *= 2;
+            rehash(capacity);
+            return;
+        }
+
+        // Double the span so a key range discovered gradually costs amortized O(1)
+        std::int64_t span = std::min<std::int64_t>(DENSE_KEY_LIMIT,
+            std::max<std::int64_t>({high - low + 1, 2 * (std::int64_t)slots.size(), (std::int64_t)MIN_HASH_CAPACITY}));
+        std::int64_t base = key < denseBase || slots.empty() ? std::max<std::int64_t>(
+            (std::int64_t)std::numeric_limits<int>::min(), high - span + 1) : low;
+        base = std::min<std::int64_t>(base, (std::int64_t)std::numeric_limits<int>::max() - span + 1);
+        std::vector<KeyAggregate> grown(span);
+        for (std::size_t i = 0; i < slots.size(); i++) {
+            grown[denseBase + i - base] = slots[i];
+        }
+        slots.swap(grown);
+        denseBase = (int)base;
+    }
+
+    // Callers add to the returned slot right away, so a counted slot is never left empty
+    KeyAggregate& at(int key) {
+        if (dense) {
+            std::uint64_t offset = (std::uint64_t)((std::int64_t)key - denseBase);
+            if (offset >= slots.size()) {
+                growDense(key);
+                return at(key);
+            }
+            KeyAggregate& slot = slots[offset];
+            if (slot.count == 0) {
+                slot.key = key;
+                used++;
+            }
+            return slot;
+        }
+        return hashSlot(key);
+    }
+
+public:
+    void add(int key, int value) {
+        at(key).add(value);
+    }
+
+    void merge(const KeyAggregate& entry) {
+        at(entry.key).merge(entry);
+    }
+
+    void merge(const AggregateTable& other) {
+        other.forEach([this](const KeyAggregate& entry) { merge(entry); });
+    }
+
+    const KeyAggregate* find(int key) const {
+        if (dense) {
+            std::uint64_t offset = (std::uint64_t)((std::int64_t)key - denseBase);
+            return offset < slots.size() && slots[offset].count > 0 ? &slots[offset] : nullptr;
+        }
+        if (slots.empty()) return nullptr;
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t index = hashIndex(key);; index = (index + 1) & mask) {
+            if (slots[index].count == 0) return nullptr;
+            if (slots[index].key == key) return &slots[index];
+        }
+    }
+
+    // Visits every key once; in dense mode the keys come in ascending order
+    template <typename F>
+    void forEach(F&& visit) const {
+        for (const KeyAggregate& entry : slots) {
+            if (entry.count > 0) visit(entry);
+        }
+    }
+
+    std::size_t size() const { return used; }
+    bool isDense() const { return dense; }
+};
+
+#endif
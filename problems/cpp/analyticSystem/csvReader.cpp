@@ -0,0 +1,121 @@
+#include "csvReader.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+MappedFile::MappedFile(const std::string& fileName) : data(nullptr), length(0), device(0), inode(0), opened(false) {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        device = info.st_dev;
+        inode = info.st_ino;
+        if (info.st_size == 0) {
+            opened = true;
+        }
+        else {
+            void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(mapping);
+                length = info.st_size;
+                opened = true;
+            }
+        }
+    }
+    ::close(fd); // the mapping stays valid without the descriptor
+}
+
+MappedFile::~MappedFile() {
+    if (length > 0) ::munmap(const_cast<char*>(data), length);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(std::exchange(other.data, nullptr)), length(std::exchange(other.length, 0)),
+      device(std::exchange(other.device, 0)), inode(std::exchange(other.inode, 0)), opened(std::exchange(other.opened, false)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        if (length > 0) ::munmap(const_cast<char*>(data), length);
+        data = std::exchange(other.data, nullptr);
+        length = std::exchange(other.length, 0);
+        device = std::exchange(other.device, 0);
+        inode = std::exchange(other.inode, 0);
+        opened = std::exchange(other.opened, false);
+    }
+    return *this;
+}
+
+namespace {
+    // 0x80 in every byte of word that equals the repeated byte in pattern
+    std::uint64_t matchBytes(std::uint64_t word, std::uint64_t pattern) {
+        constexpr std::uint64_t LOW7 = 0x7F7F7F7F7F7F7F7Full;
+        std::uint64_t diff = word ^ pattern;
+        return ~(((diff & LOW7) + LOW7) | diff | LOW7);
+    }
+
+    // Gathers the top bit of each byte into the low 8 bits
+    std::uint64_t gatherTopBits(std::uint64_t bytes) {
+        return ((bytes >> 7) * 0x0102040810204080ull) >> 56;
+    }
+}
+
+DelimiterMasks scanBlockScalar(const char* block) {
+    DelimiterMasks masks{0, 0};
+    for (std::size_t i = 0; i < SCAN_BLOCK_SIZE; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, block + i, sizeof(word));
+        masks.commas |= gatherTopBits(matchBytes(word, 0x2C2C2C2C2C2C2C2Cull)) << i;
+        masks.newlines |= gatherTopBits(matchBytes(word, 0x0A0A0A0A0A0A0A0Aull)) << i;
+    }
+    return masks;
+}
+
+#if defined(__x86_64__)
+
+DelimiterMasks scanBlockSse2(const char* block) {
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    DelimiterMasks masks{0, 0};
+    for (std::size_t i = 0; i < SCAN_BLOCK_SIZE; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        masks.commas |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comma)) << i;
+        masks.newlines |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << i;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2"))) DelimiterMasks scanBlockAvx2(const char* block) {
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    DelimiterMasks masks;
+    masks.commas = (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, comma))
+        | (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, comma)) << 32;
+    masks.newlines = (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline))
+        | (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)) << 32;
+    return masks;
+}
+
+BlockScanner getBlockScanner() {
+    static const BlockScanner scanner = __builtin_cpu_supports("avx2") ? scanBlockAvx2 : scanBlockSse2;
+    return scanner;
+}
+
+#else
+
+DelimiterMasks scanBlockSse2(const char* block) { return scanBlockScalar(block); }
+DelimiterMasks scanBlockAvx2(const char* block) { return scanBlockScalar(block); }
+
+BlockScanner getBlockScanner() {
+    return scanBlockScalar;
+}
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef CSVREADER_HPP
+#define CSVREADER_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+// Read-only mapping of a whole file. Empty files are open with an empty range.
+class MappedFile {
+private:
+    const char* data;
+    std::size_t length;
+    std::uint64_t device;
+    std::uint64_t inode;
+    bool opened;
+
+public:
+    explicit MappedFile(const std::string& fileName);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool isOpen() const { return opened; }
+    const char* begin() const { return data; }
+    const char* end() const { return data + length; }
+    std::size_t size() const { return length; }
+    // Device and inode identify the file across renames and tell a replaced file from an appended one
+    std::uint64_t getDevice() const { return device; }
+    std::uint64_t getInode() const { return inode; }
+};
+
+constexpr std::size_t SCAN_BLOCK_SIZE = 64;
+
+// Bit i is set when byte i of a 64-byte block is ',' or '\n'
+struct DelimiterMasks {
+    std::uint64_t commas;
+    std::uint64_t newlines;
+};
+
+using BlockScanner = DelimiterMasks (*)(const char* block);
+
+DelimiterMasks scanBlockScalar(const char* block); // SWAR, any CPU
+DelimiterMasks scanBlockSse2(const char* block); // x86-64 only
+DelimiterMasks scanBlockAvx2(const char* block); // x86-64 with AVX2 only
+
+// Widest scanner this CPU supports, chosen once at first use
+BlockScanner getBlockScanner();
+
+struct CsvStats {
+    std::size_t rows = 0;
+    std::size_t badRows = 0;
+};
+
+// Parses an optionally signed decimal integer at cursor and leaves cursor on the
+// first byte after it. False when there are no digits or the value overflows Int.
+template <typename Int>
+inline bool parseInteger(const char*& cursor, const char* end, Int& value) {
+    static_assert(std::is_signed_v<Int>, "parseInteger handles signed types");
+    using Magnitude = std::make_unsigned_t<Int>;
+
+    bool negative = false;
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        negative = *cursor == '-';
+        cursor++;
+    }
+    const Magnitude limit = (Magnitude)std::numeric_limits<Int>::max() + (negative ? 1 : 0);
+    const char* digits = cursor;
+    Magnitude magnitude = 0;
+    while (cursor < end && (unsigned char)(*cursor - '0') < 10) {
+        Magnitude digit = (Magnitude)(*cursor - '0');
+        if (magnitude > (limit - digit) / 10) return false;
+        magnitude = magnitude * 10 + digit;
+        cursor++;
+    }
+    if (cursor == digits) return false;
+    value = negative ? (Int)(Magnitude)(0 - magnitude) : (Int)magnitude;
+    return true;
+}
+
+// Start of the first line beginning at or after position. Splitting [begin, end) at
+// aligned positions gives every line, including one that straddles the split,
+// to exactly one side.
+inline const char* alignToLine(const char* begin, const char* position, const char* end) {
+    if (position <= begin) return begin;
+    if (position >= end) return end;
+    const char* newline = static_cast<const char*>(std::memchr(position - 1, '\n', end - (position - 1)));
+    return newline ? newline + 1 : end;
+}
+
+// Decodes up to 8 ASCII digits at once (SWAR). Digits are right-aligned in a
+// word padded with '0', so the value is the same as for the unpadded field.
+// Bytes before readable may be loaded past the digits; a fixed 8-byte load is
+// much cheaper than a variable-length copy.
+inline bool decodeDigits(const char* digits, std::size_t count, const char* readable, std::uint64_t& value) {
+    constexpr std::uint64_t ZEROS = 0x3030303030303030ull;
+    std::uint64_t word = 0;
+    if (readable - digits >= 8) {
+        std::memcpy(&word, digits, 8);
+    }
+    else {
+        std::memcpy(&word, digits, count);
+    }
+    if (count < 8) word = (word << (8 * (8 - count))) | (ZEROS >> (8 * count)); // shifts out the extra bytes
+
+    // Every byte must be in '0'..'9': high nibble 3, and adding 6 keeps it 3
+    if ((word & 0xF0F0F0F0F0F0F0F0ull) != ZEROS) return false;
+    if (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) != ZEROS) return false;
+
+    word -= ZEROS;
+    word = (word * 10) + (word >> 8);
+    word = (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+        + (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    value = word;
+    return true;
+}
+
+inline bool isAsciiSpace(char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+// Parses [begin, end) as an optionally signed integer surrounded by optional ASCII
+// whitespace, as stoi did; any other text around the number makes it false.
+// readable is the end of the buffer holding the field.
+template <typename Int>
+inline bool parseField(const char* begin, const char* end, const char* readable, Int& value) {
+    static_assert(sizeof(Int) <= sizeof(std::int64_t), "parseField decodes at most 16 digits");
+    while (begin < end && isAsciiSpace(*begin)) begin++;
+    while (end > begin && isAsciiSpace(end[-1])) end--;
+    if (begin == end) return false;
+    // Sign handling without branches: a random mix of signs would defeat the predictor
+    bool negative = *begin == '-';
+    const char* digits = begin + (negative | (*begin == '+'));
+    std::size_t count = end - digits;
+    if (count == 0 || count > 16) {
+        // Empty, or long enough to need leading zeros: the byte-at-a-time parser decides
+        const char* cursor = begin;
+        return parseInteger(cursor, end, value) && cursor == end;
+    }
+
+    std::uint64_t magnitude;
+    if (count <= 8) {
+        if (!decodeDigits(digits, count, readable, magnitude)) return false;
+    }
+    else {
+        std::uint64_t high, low;
+        if (!decodeDigits(digits, count - 8, readable, high)
+            || !decodeDigits(digits + count - 8, 8, readable, low)) return false;
+        magnitude = high * 100000000ull + low;
+    }
+
+    const std::uint64_t limit = (std::uint64_t)std::numeric_limits<Int>::max() + negative;
+    if (magnitude > limit) return false;
+    std::uint64_t signMask = 0 - (std::uint64_t)negative;
+    value = (Int)((magnitude ^ signMask) - signMask);
+    return true;
+}
+
+// Calls row(key, value) for every "key,value" line in [begin, end). Columns after
+// the second are ignored, "\r\n" endings and a last line without a newline are
+// accepted, blank lines are skipped and any other line, including one with text
+// after a number ("12abc"), is counted as bad.
+// Delimiters are found 64 bytes at a time; rows are cut at the set mask bits.
+template <typename RowHandler>
+CsvStats parseCsvRows(const char* begin, const char* end, RowHandler&& row,
+    BlockScanner scan = getBlockScanner()) {
+    CsvStats stats;
+    const char* lineStart = begin;
+    const char* firstComma = nullptr;
+    const char* secondComma = nullptr;
+
+    auto finishLine = [&](const char* lineEnd) {
+        if (lineEnd > lineStart && lineEnd[-1] == '\r') lineEnd--;
+        if (lineEnd == lineStart) return;
+
+        int key, value;
+        bool valid = firstComma && firstComma < lineEnd && parseField(lineStart, firstComma, end, key)
+            && parseField(firstComma + 1, secondComma ? secondComma : lineEnd, end, value);
+        if (valid) {
+            row(key, value);
+            stats.rows++;
+        }
+        else {
+            stats.badRows++;
+        }
+    };
+
+    alignas(SCAN_BLOCK_SIZE) char tail[SCAN_BLOCK_SIZE];
+    std::size_t length = end - begin;
+    for (std::size_t offset = 0; offset < length; offset += SCAN_BLOCK_SIZE) {
+        const char* block = begin + offset;
+        std::size_t available = length - offset;
+        DelimiterMasks masks;
+        if (available >= SCAN_BLOCK_SIZE) {
+            masks = scan(block);
+        }
+        else {
+            // The mapping may end right after the data, so the last partial block is copied
+            std::memset(tail, 0, SCAN_BLOCK_SIZE);
+            std::memcpy(tail, block, available);
+            masks = scan(tail);
+        }
+
+        std::uint64_t delimiters = masks.commas | masks.newlines;
+        while (delimiters) {
+            int bit = std::countr_zero(delimiters);
+            delimiters &= delimiters - 1;
+            const char* position = block + bit;
+            if ((masks.newlines >> bit) & 1) {
+                finishLine(position);
+                lineStart = position + 1;
+                firstComma = nullptr;
+                secondComma = nullptr;
+            }
+            else if (!firstComma) {
+                firstComma = position;
+            }
+            else if (!secondComma) {
+                secondComma = position;
+            }
+        }
+    }
+    if (lineStart < end) finishLine(end);
+    return stats;
+}
+
+#endif
@@ -1,65 +1,540 @@
+#include "csvReader.hpp"
+#include "aggregateTable.hpp"
+#include "sketches.hpp"
+#include "../producerConsumer/threadPool.hpp"
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
-#include <sstream>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <map>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <filesystem>
 namespace fs = std::filesystem;
 
+// Per-key totals of one worker; merging is order-independent, so the parallel
+// result matches the serial one
+struct KeyTotals {
+    AggregateTable keys;
+    SketchSet sketches;
+    std::size_t rows = 0;
+    std::size_t badRows = 0;
+
+    explicit KeyTotals(std::size_t heavyKeyCapacity = DEFAULT_HEAVY_KEYS) : sketches(heavyKeyCapacity) {}
+
+    void merge(const KeyTotals& other) {
+        keys.merge(other.keys);
+        sketches.merge(other.sketches);
+        rows += other.rows;
+        badRows += other.badRows;
+    }
+};
+
+constexpr std::size_t DEFAULT_CHUNK_SIZE = 64 << 20; // bytes of one file parsed by one task
+constexpr std::uint32_t CHECKPOINT_MAGIC = 0x4B434E41; // "ANCK"
+// 2 added the sketch section, 3 the file device, 4 distinct values per heavy key
+constexpr std::uint32_t CHECKPOINT_VERSION = 4;
+
+struct AnalyticOptions {
+    std::size_t threadCount = std::thread::hardware_concurrency();
+    std::size_t chunkSize = DEFAULT_CHUNK_SIZE;
+    std::string checkpointPath; // empty: start from scratch and never save
+    bool streaming = false; // a last line without newline waits until it is complete
+    bool exact = true; // exact per-key table; memory grows with the number of keys
+    bool sketches = false; // bounded-memory sketches, needed when the keys do not fit in memory
+    std::size_t topKeys = 10; // heavy hitters reported; four times as many are tracked
+};
+
 class Analytic {
 private:
+    // Byte range of one file; both ends are moved to line starts when parsed
+    struct Chunk {
+        std::size_t file;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    // The part of a file not aggregated yet
+    struct FileRange {
+        MappedFile mapping;
+        std::size_t start;
+        std::size_t stop;
+    };
+
+    // How far a file has been read; a new device or inode means the file was replaced
+    struct FileProgress {
+        std::uint64_t device = 0;
+        std::uint64_t inode = 0;
+        std::uint64_t offset = 0;
+
+        bool isFile(const MappedFile& file) const {
+            return device == file.getDevice() && inode == file.getInode();
+        }
+    };
+
     std::string path;
-    std::unordered_map<int, int> countKeys;
-    std::unordered_map<int, int> sumKeys;
+    AnalyticOptions options;
+    ThreadPool pool;
+    KeyTotals totals;
+    std::unordered_map<std::string, FileProgress> progress; // by file name inside path
+    // Progress of files whose name went away, by device and inode; a file renamed
+    // inside path takes its entry back instead of being read again
+    std::map<std::pair<std::uint64_t, std::uint64_t>, FileProgress> detached;
+    bool dirty = false; // changed since the last checkpoint
+    std::unordered_set<std::string> ownFiles; // checkpoint files inside path, never read as data
+
+    std::vector<std::string> listFiles() const {
+        std::vector<std::string> names;
+        for (const auto & entry : fs::directory_iterator(path)) {
+            std::string name = entry.path().filename();
+            if (entry.is_regular_file() && !ownFiles.count(name)) names.push_back(name);
+        }
+        return names;
+    }
+
+    void findOwnFiles() {
+        if (options.checkpointPath.empty()) return;
+        std::error_code checkpointError, directoryError;
+        fs::path checkpoint = fs::weakly_canonical(options.checkpointPath, checkpointError);
+        fs::path directory = fs::weakly_canonical(path, directoryError);
+        if (checkpointError || directoryError || checkpoint.parent_path() != directory) return;
+        ownFiles.insert(checkpoint.filename());
+        ownFiles.insert(checkpoint.filename().string() + ".tmp");
+    }
+
+    // Flushes a file, or the entries of a directory, to the disk
+    static bool syncPath(const std::string& target) {
+        int fd = ::open(target.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        bool synced = ::fsync(fd) == 0;
+        ::close(fd);
+        return synced;
+    }
+
+    std::size_t heavyKeyCapacity() const { return std::max<std::size_t>(1, options.topKeys * 4); }
+
+    // End of the last complete line at or after offset
+    static std::size_t completeLinesEnd(const MappedFile& file, std::size_t offset) {
+        if (offset >= file.size()) return offset;
+        const void* newline = ::memrchr(file.begin() + offset, '\n', file.size() - offset);
+        return newline ? static_cast<const char*>(newline) - file.begin() + 1 : offset;
+    }
 
 public:
-    Analytic(std::string path) : path(path) { processFiles();}
+    Analytic(std::string path, AnalyticOptions options = AnalyticOptions())
+        : path(path), options(options), pool(options.threadCount), totals(heavyKeyCapacity()) {
+        if (this->options.chunkSize == 0) this->options.chunkSize = 1;
+        findOwnFiles();
+        if (!this->options.checkpointPath.empty()) loadCheckpoint();
+        rescan();
+    }
 
-    void processFiles() {
-        for (const auto & entry : fs::directory_iterator(path)) {
-            std::cout << entry.path() << std::endl;
-            processData(entry.path());
+    // Reads whatever the directory gained since the last scan or checkpoint
+    void rescan() {
+        std::vector<std::string> names = listFiles();
+        std::unordered_set<std::string> present(names.begin(), names.end());
+        for (auto it = progress.begin(); it != progress.end();) {
+            if (present.count(it->first)) {
+                it++;
+            }
+            else {
+                detach(it->second);
+                it = progress.erase(it);
+                dirty = true;
+            }
         }
+        processFiles(names);
     }
 
-    void processData(std::string fileName) {
-        std::ifstream file(fileName);
-        if (!file.is_open()) {
-            std::cerr << "Failed to open file " << path << std::endl;
+    void detach(const FileProgress& seen) {
+        detached[{seen.device, seen.inode}] = seen;
+    }
+
+    // Aggregates the bytes of each named file past its recorded offset. Detached
+    // entries not claimed by one of the names are dropped.
+    void processFiles(const std::vector<std::string>& names) {
+        std::vector<FileRange> files;
+        for (const std::string& name : names) {
+            fs::path filePath = fs::path(path) / name;
+            MappedFile file(filePath);
+            if (!file.isOpen()) {
+                std::cerr << "Failed to open file " << filePath << std::endl;
+                continue;
+            }
+            FileProgress& seen = progress[name];
+            if (!seen.isFile(file)) {
+                auto moved = detached.find({file.getDevice(), file.getInode()});
+                if (moved != detached.end()) {
+                    seen = moved->second;
+                    detached.erase(moved);
+                    dirty = true;
+                }
+            }
+            if (!seen.isFile(file) || seen.offset > file.size()) {
+                if (seen.offset > 0) {
+                    std::cerr << "File " << filePath << " was replaced or truncated, reading it again" << std::endl;
+                }
+                seen = FileProgress{file.getDevice(), file.getInode(), 0};
+            }
+            std::size_t stop = options.streaming ? completeLinesEnd(file, seen.offset) : file.size();
+            if (stop <= seen.offset) continue;
+
+            std::cout << filePath << std::endl;
+            files.push_back(FileRange{std::move(file), (std::size_t)seen.offset, stop});
+            seen.offset = stop;
+            dirty = true;
         }
-        std::string line;
-        while (std::getline(file, line)) {
-            std::stringstream ssLine(line);
-            std::string key, value;
+        detached.clear(); // gone for good, and the inode may be reused
+
+        // Large files are cut into several chunks so a single huge file still uses every worker
+        std::vector<Chunk> chunks;
+        for (std::size_t file = 0; file < files.size(); file++) {
+            for (std::size_t offset = files[file].start; offset < files[file].stop; offset += options.chunkSize) {
+                chunks.push_back(Chunk{file, offset, std::min(files[file].stop, offset + options.chunkSize)});
+            }
+        }
+        if (chunks.empty()) return;
+
+        // One partial table per worker; workers pull the next chunk from a shared counter
+        std::size_t partitions = std::min(chunks.size(), pool.getWorkerCount());
+        std::vector<KeyTotals> partials(partitions, KeyTotals(heavyKeyCapacity()));
+        std::atomic<std::size_t> nextChunk(0);
+        pool.parallelFor((std::size_t)0, partitions, [&](std::size_t partition) {
+            std::size_t chunk;
+            while ((chunk = nextChunk.fetch_add(1, std::memory_order_relaxed)) < chunks.size()) {
+                const Chunk& range = chunks[chunk];
+                processData(files[range.file], range.begin, range.end, partials[partition]);
+            }
+        }, 1);
 
-            std::getline(ssLine, key, ',');
-            std::getline(ssLine, value, ',');
-            countKeys[stoi(key)]++;
-            sumKeys[stoi(key)] += stoi(value);
+        // Pairwise tree merge, each round halving the partials in parallel
+        for (std::size_t step = 1; step < partitions; step *= 2) {
+            std::size_t pairs = (partitions + 2 * step - 1) / (2 * step);
+            pool.parallelFor((std::size_t)0, pairs, [&](std::size_t pair) {
+                std::size_t left = pair * 2 * step;
+                if (left + step < partitions) partials[left].merge(partials[left + step]);
+            }, 1);
         }
+        totals.merge(partials[0]);
     }
 
-    void printFreqKeys() {
-        for (auto it = countKeys.begin(); it != countKeys.end(); it++) {
-            std::cout << "Key: " << it->first << " - frequency: " << it->second << "\n" << std::endl;
+    // Parses the lines that start inside [from, to) of file; a line crossing `to`
+    // belongs to this chunk and is skipped by the next one
+    void processData(const FileRange& file, std::size_t from, std::size_t to, KeyTotals& into) {
+        const char* start = file.mapping.begin() + file.start;
+        const char* stop = file.mapping.begin() + file.stop;
+        const char* begin = alignToLine(start, file.mapping.begin() + from, stop);
+        const char* end = alignToLine(start, file.mapping.begin() + to, stop);
+        // Keys and values are parsed straight from the mapped bytes, no per-row allocation.
+        // The aggregate choice is made once per chunk, not per row.
+        auto parse = [&](auto&& row) {
+            CsvStats stats = parseCsvRows(begin, end, row);
+            into.rows += stats.rows;
+            into.badRows += stats.badRows;
+        };
+        if (!options.sketches) {
+            parse([&into](int key, int value) { into.keys.add(key, value); });
+        }
+        else if (!options.exact) {
+            parse([&into](int key, int value) { into.sketches.add(key, value); });
+        }
+        else {
+            parse([&into](int key, int value) {
+                into.keys.add(key, value);
+                into.sketches.add(key, value);
+            });
         }
     }
 
-    void printSumKeys() {
-        for (auto it = sumKeys.begin(); it != sumKeys.end(); it++) {
-            std::cout << "Key: " << it->first << " - sum: " << it->second << "\n" << std::endl;
+    // Follows the directory with inotify until stop is set, reading new files and
+    // appended lines as they land and checkpointing at most once per interval
+    void watch(const std::atomic<bool>& stop, std::chrono::seconds checkpointInterval) {
+        int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0 || ::inotify_add_watch(fd, path.c_str(),
+                IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+            std::cerr << "Failed to watch " << path << std::endl;
+            if (fd >= 0) ::close(fd);
+            return;
+        }
+        rescan(); // files written before the watch was in place
+
+        auto lastCheckpoint = std::chrono::steady_clock::now();
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (!stop.load(std::memory_order_relaxed)) {
+            pollfd ready{fd, POLLIN, 0};
+            if (::poll(&ready, 1, 1000) > 0) {
+                // Coalesce a burst of events so each file is read once
+                std::unordered_set<std::string> changed;
+                bool overflow = false;
+                ssize_t length;
+                while ((length = ::read(fd, buffer, sizeof(buffer))) > 0) {
+                    for (char* cursor = buffer; cursor < buffer + length;) {
+                        const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+                        if (event->mask & IN_Q_OVERFLOW) {
+                            overflow = true;
+                        }
+                        else if (event->len > 0 && (event->mask & (IN_DELETE | IN_MOVED_FROM))) {
+                            changed.erase(event->name);
+                            auto gone = progress.find(event->name);
+                            if (gone != progress.end()) {
+                                // A rename inside path also queues IN_MOVED_TO, read in this same burst
+                                if (event->mask & IN_MOVED_FROM) detach(gone->second);
+                                progress.erase(gone);
+                                dirty = true;
+                            }
+                        }
+                        else if (event->len > 0) {
+                            changed.insert(event->name);
+                        }
+                        cursor += sizeof(inotify_event) + event->len;
+                    }
+                }
+                if (overflow) {
+                    rescan();
+                }
+                else {
+                    std::vector<std::string> names;
+                    for (const std::string& name : changed) {
+                        std::error_code error;
+                        if (!ownFiles.count(name) && fs::is_regular_file(fs::path(path) / name, error)) names.push_back(name);
+                    }
+                    processFiles(names);
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (dirty && now - lastCheckpoint >= checkpointInterval) {
+                saveCheckpoint();
+                lastCheckpoint = now;
+            }
+        }
+        ::close(fd);
+    }
+
+    // Writes offsets and aggregates to a temporary file, syncs it, then renames it
+    // over the checkpoint so a crash or power loss leaves either the old or the new one
+    void saveCheckpoint() {
+        if (options.checkpointPath.empty()) return;
+        std::string temporary = options.checkpointPath + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            writeValue(out, CHECKPOINT_MAGIC);
+            writeValue(out, CHECKPOINT_VERSION);
+            writeValue(out, (std::uint64_t)totals.rows);
+            writeValue(out, (std::uint64_t)totals.badRows);
+            writeValue(out, (std::uint64_t)progress.size());
+            for (const auto& [name, seen] : progress) {
+                writeValue(out, (std::uint32_t)name.size());
+                out.write(name.data(), name.size());
+                writeValue(out, seen.device);
+                writeValue(out, seen.inode);
+                writeValue(out, seen.offset);
+            }
+            writeValue(out, (std::uint64_t)totals.keys.size());
+            totals.keys.forEach([&out](const KeyAggregate& entry) {
+                writeValue(out, entry.key);
+                writeValue(out, entry.count);
+                writeValue(out, entry.sum);
+                writeValue(out, entry.min);
+                writeValue(out, entry.max);
+            });
+            writeValue(out, (std::uint8_t)options.sketches);
+            if (options.sketches) totals.sketches.save(out);
+            if (!out.flush()) {
+                std::cerr << "Failed to write checkpoint " << temporary << std::endl;
+                return;
+            }
         }
+        if (!syncPath(temporary)) {
+            std::cerr << "Failed to sync checkpoint " << temporary << std::endl;
+            return;
+        }
+        std::error_code error;
+        fs::rename(temporary, options.checkpointPath, error);
+        if (error) {
+            std::cerr << "Failed to replace checkpoint " << options.checkpointPath << ": " << error.message() << std::endl;
+            return;
+        }
+        // The rename itself is durable only once the directory is synced
+        fs::path directory = fs::path(options.checkpointPath).parent_path();
+        if (!syncPath(directory.empty() ? "." : directory.string())) {
+            std::cerr << "Failed to sync the directory of checkpoint " << options.checkpointPath << std::endl;
+        }
+        dirty = false;
+    }
+
+    // Restores offsets and aggregates; a missing or unreadable checkpoint starts from scratch
+    bool loadCheckpoint() {
+        std::ifstream in(options.checkpointPath, std::ios::binary);
+        if (!in) return false;
+
+        std::uint32_t magic = 0, version = 0;
+        std::uint64_t rows = 0, badRows = 0, fileCount = 0, keyCount = 0;
+        KeyTotals restored(heavyKeyCapacity());
+        // Before version 3 the device was not saved; the files were on the directory's
+        struct stat directory;
+        std::uint64_t defaultDevice = ::stat(path.c_str(), &directory) == 0 ? directory.st_dev : 0;
+        std::unordered_map<std::string, FileProgress> restoredProgress;
+        bool valid = readValue(in, magic) && magic == CHECKPOINT_MAGIC && readValue(in, version)
+            && version >= 1 && version <= CHECKPOINT_VERSION && readValue(in, rows) && readValue(in, badRows)
+            && readValue(in, fileCount);
+        for (std::uint64_t i = 0; valid && i < fileCount; i++) {
+            std::uint32_t nameLength = 0;
+            FileProgress seen;
+            valid = readValue(in, nameLength);
+            std::string name(valid ? nameLength : 0, '\0');
+            seen.device = defaultDevice;
+            valid = valid && in.read(name.data(), nameLength) && (version < 3 || readValue(in, seen.device))
+                && readValue(in, seen.inode) && readValue(in, seen.offset);
+            if (valid) restoredProgress[name] = seen;
+        }
+        valid = valid && readValue(in, keyCount);
+        for (std::uint64_t i = 0; valid && i < keyCount; i++) {
+            KeyAggregate entry;
+            valid = readValue(in, entry.key) && readValue(in, entry.count) && readValue(in, entry.sum)
+                && readValue(in, entry.min) && readValue(in, entry.max);
+            if (valid) restored.keys.merge(entry);
+        }
+        std::uint8_t hasSketches = 0;
+        if (valid && version >= 2) {
+            valid = readValue(in, hasSketches) && (!hasSketches || restored.sketches.load(in, version >= 4));
+        }
+        if (!valid) {
+            std::cerr << "Ignoring unreadable checkpoint " << options.checkpointPath << std::endl;
+            return false;
+        }
+
+        if (options.sketches && !hasSketches) {
+            std::cerr << "Checkpoint " << options.checkpointPath << " has no sketches; they cover only new data" << std::endl;
+        }
+        // Saving without them would lose them, and skipping new rows would leave a gap
+        // a later --sketches run could not see, so they keep being updated
+        if (hasSketches) options.sketches = true;
+        restored.rows = rows;
+        restored.badRows = badRows;
+        totals = std::move(restored);
+        progress = std::move(restoredProgress);
+        return true;
+    }
+
+    std::size_t getRows() const { return totals.rows; }
+    std::size_t getKeyCount() const { return totals.keys.size(); }
+    // Lines whose key or value is not a whole integer; whitespace around a field is allowed
+    std::size_t getBadRows() const { return totals.badRows; }
+
+    void printSketches() {
+        const SketchSet& sketches = totals.sketches;
+        std::cout << std::fixed << std::setprecision(0)
+            << "Distinct keys: ~" << sketches.distinctKeys.estimate()
+            << " - distinct values: ~" << sketches.distinctValues.estimate() << "\n" << std::endl;
+        std::cout << "Values p50: " << sketches.values.quantile(0.5) << " - p90: " << sketches.values.quantile(0.9)
+            << " - p99: " << sketches.values.quantile(0.99) << "\n" << std::endl;
+        for (const SpaceSaving::Counter* counter : sketches.heavyKeys.top(options.topKeys)) {
+            std::cout << "Heavy key: " << counter->key << " - frequency: " << counter->count
+                << " (overcount at most " << counter->error << ") - distinct values: ~"
+                << counter->distinctValues.estimate() << " - p50: " << counter->values.quantile(0.5)
+                << " - p99: " << counter->values.quantile(0.99) << "\n" << std::endl;
+        }
+    }
+
+    void printFreqKeys() {
+        totals.keys.forEach([](const KeyAggregate& entry) {
+            std::cout << "Key: " << entry.key << " - frequency: " << entry.count << "\n" << std::endl;
+        });
+    }
+
+    void printSumKeys() {
+        totals.keys.forEach([](const KeyAggregate& entry) {
+            std::cout << "Key: " << entry.key << " - sum: " << entry.sum << "\n" << std::endl;
+        });
+    }
+
+    void printRangeKeys() {
+        totals.keys.forEach([](const KeyAggregate& entry) {
+            std::cout << "Key: " << entry.key << " - min: " << entry.min << " - max: " << entry.max << "\n" << std::endl;
+        });
     }
 };
 
-int main() {
-    std::cout << "Please enter csv path: \n" << std::endl;
+static std::atomic<bool> stopRequested(false);
+
+int main(int argc, char** argv) {
     std::string path;
-    std::cin >> path;
+    AnalyticOptions options;
+    bool watching = false;
+    std::size_t checkpointInterval = 60;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            options.threadCount = std::stoull(argv[++i]);
+        }
+        else if (arg == "--chunk-size" && i + 1 < argc) {
+            options.chunkSize = std::stoull(argv[++i]);
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpointPath = argv[++i];
+        }
+        else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            checkpointInterval = std::stoull(argv[++i]);
+        }
+        else if (arg == "--sketches") {
+            options.sketches = true;
+        }
+        else if (arg == "--sketches-only") {
+            options.sketches = true;
+            options.exact = false;
+        }
+        else if (arg == "--top" && i + 1 < argc) {
+            options.topKeys = std::stoull(argv[++i]);
+        }
+        else if (arg == "--watch") {
+            watching = true;
+        }
+        else if (path.empty() && arg.rfind("--", 0) != 0) {
+            path = arg;
+        }
+        else {
+            std::cerr << "Usage: readCsvFiles [--threads N] [--chunk-size BYTES] [--checkpoint FILE]\n"
+                << "    [--watch [--checkpoint-interval SECONDS]] [--sketches | --sketches-only] [--top N]\n"
+                << "    [csv directory]" << std::endl;
+            return 1;
+        }
+    }
+    if (path.empty()) {
+        std::cout << "Please enter csv path: \n" << std::endl;
+        std::cin >> path;
+    }
 
-    Analytic analytic(path);
-    analytic.printFreqKeys();
-    analytic.printSumKeys();
+    // Files being appended to may end in a partial line, so watching only reads complete ones
+    options.streaming = watching;
+    Analytic analytic(path, options);
+    if (watching) {
+        std::signal(SIGINT, [](int) { stopRequested.store(true); });
+        std::signal(SIGTERM, [](int) { stopRequested.store(true); });
+        analytic.watch(stopRequested, std::chrono::seconds(checkpointInterval));
+    }
+    analytic.saveCheckpoint();
+
+    if (options.exact) {
+        analytic.printFreqKeys();
+        analytic.printSumKeys();
+        analytic.printRangeKeys();
+    }
+    if (options.sketches) {
+        analytic.printSketches();
+    }
+    if (analytic.getBadRows() > 0) {
+        std::cerr << "Skipped " << analytic.getBadRows() << " malformed rows" << std::endl;
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,413 @@
+#ifndef SKETCHES_HPP
+#define SKETCHES_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+constexpr int DEFAULT_HLL_PRECISION = 14; // 16K registers, about 0.8% standard error
+constexpr int KEY_HLL_PRECISION = 8; // 256 registers per heavy key, about 6.5% standard error
+constexpr std::size_t DEFAULT_KLL_K = 200; // about 1.3% rank error
+constexpr std::size_t KEY_KLL_K = 64; // smaller quantile sketch kept per heavy key
+constexpr std::size_t DEFAULT_HEAVY_KEYS = 64;
+
+template <typename T>
+inline void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+inline bool readValue(std::istream& in, T& value) {
+    return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+// splitmix64 finalizer: spreads consecutive integers over all 64 bits
+inline std::uint64_t hashInteger(std::uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+// Distinct count estimate in 2^precision bytes; merging takes the register-wise max.
+// Only sketches of the same precision merge, so load refuses any other precision.
+class HyperLogLog {
+private:
+    int precision;
+    std::vector<std::uint8_t> registers;
+
+public:
+    explicit HyperLogLog(int precision = DEFAULT_HLL_PRECISION)
+        : precision(precision), registers(std::size_t(1) << precision, 0) {}
+
+    void add(std::int64_t value) {
+        std::uint64_t hash = hashInteger((std::uint64_t)value);
+        std::size_t index = hash >> (64 - precision);
+        // The guard bit bounds the rank when the remaining bits are all zero
+        std::uint8_t rank = (std::uint8_t)(std::countl_zero((hash << precision) | (1ull << (precision - 1))) + 1);
+        registers[index] = std::max(registers[index], rank);
+    }
+
+    void merge(const HyperLogLog& other) {
+        assert(other.precision == precision && "HyperLogLog precisions differ");
+        for (std::size_t i = 0; i < registers.size(); i++) {
+            registers[i] = std::max(registers[i], other.registers[i]);
+        }
+    }
+
+    double estimate() const {
+        double m = (double)registers.size();
+        double inverseSum = 0;
+        std::size_t zeros = 0;
+        for (std::uint8_t rank : registers) {
+            inverseSum += std::ldexp(1.0, -rank);
+            zeros += rank == 0;
+        }
+        double raw = (0.7213 / (1 + 1.079 / m)) * m * m / inverseSum;
+        // Linear counting is more accurate while many registers are still empty
+        if (raw <= 2.5 * m && zeros > 0) return m * std::log(m / zeros);
+        return raw;
+    }
+
+    void clear() {
+        std::fill(registers.begin(), registers.end(), 0);
+    }
+
+    void save(std::ostream& out) const {
+        writeValue(out, (std::uint8_t)precision);
+        out.write(reinterpret_cast<const char*>(registers.data()), registers.size());
+    }
+
+    bool load(std::istream& in) {
+        std::uint8_t savedPrecision;
+        if (!readValue(in, savedPrecision) || savedPrecision != precision) return false;
+        return (bool)in.read(reinterpret_cast<char*>(registers.data()), registers.size());
+    }
+};
+
+// KLL quantile sketch (Karnin, Lang, Liberty 2016). Level h holds items of weight
+// 2^h; a full level is sorted and every other item, from a random offset, moves up.
+class KllSketch {
+private:
+    std::size_t k;
+    std::uint64_t count = 0;
+    std::uint64_t seed = 0x2545F4914F6CDD1Dull;
+    std::vector<std::vector<int>> levels;
+
+    // Lower levels get geometrically smaller capacities, never below 2
+    std::size_t capacity(std::size_t level) const {
+        std::size_t depth = levels.size() - 1 - level;
+        return std::max<std::size_t>(2, (std::size_t)std::ceil(k * std::pow(2.0 / 3.0, (double)depth)));
+    }
+
+    bool randomBit() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed & 1;
+    }
+
+    void compress() {
+        for (std::size_t level = 0; level < levels.size(); level++) {
+            if (levels[level].size() < capacity(level)) continue;
+            if (level + 1 == levels.size()) levels.emplace_back();
+
+            std::vector<int>& items = levels[level];
+            std::sort(items.begin(), items.end());
+            // An odd item out stays behind so the total weight is preserved exactly
+            std::size_t paired = items.size() & ~std::size_t(1);
+            for (std::size_t i = randomBit() ? 1 : 0; i < paired; i += 2) {
+                levels[level + 1].push_back(items[i]);
+            }
+            items.erase(items.begin(), items.begin() + paired);
+        }
+    }
+
+public:
+    explicit KllSketch(std::size_t k = DEFAULT_KLL_K) : k(std::max<std::size_t>(k, 8)), levels(1) {}
+
+    void add(int value) {
+        levels[0].push_back(value);
+        count++;
+        if (levels[0].size() >= capacity(0)) compress();
+    }
+
+    void merge(const KllSketch& other) {
+        if (levels.size() < other.levels.size()) levels.resize(other.levels.size());
+        for (std::size_t level = 0; level < other.levels.size(); level++) {
+            levels[level].insert(levels[level].end(), other.levels[level].begin(), other.levels[level].end());
+        }
+        count += other.count;
+        compress();
+    }
+
+    void clear() {
+        count = 0;
+        levels.assign(1, std::vector<int>());
+    }
+
+    std::uint64_t size() const { return count; }
+
+    // Value at normalized rank fraction in [0, 1]; 0 when empty
+    int quantile(double fraction) const {
+        std::vector<std::pair<int, std::uint64_t>> weighted;
+        std::uint64_t total = 0;
+        for (std::size_t level = 0; level < levels.size(); level++) {
+            for (int item : levels[level]) {
+                weighted.emplace_back(item, std::uint64_t(1) << level);
+                total += std::uint64_t(1) << level;
+            }
+        }
+        if (weighted.empty()) return 0;
+        std::sort(weighted.begin(), weighted.end());
+        double target = std::clamp(fraction, 0.0, 1.0) * total;
+        std::uint64_t seen = 0;
+        for (const auto& [item, weight] : weighted) {
+            seen += weight;
+            if (seen >= target) return item;
+        }
+        return weighted.back().first;
+    }
+
+    void save(std::ostream& out) const {
+        writeValue(out, (std::uint32_t)k);
+        writeValue(out, count);
+        writeValue(out, (std::uint32_t)levels.size());
+        for (const std::vector<int>& items : levels) {
+            writeValue(out, (std::uint32_t)items.size());
+            out.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(int));
+        }
+    }
+
+    bool load(std::istream& in) {
+        std::uint32_t savedK, levelCount;
+        if (!readValue(in, savedK) || !readValue(in, count) || !readValue(in, levelCount)) return false;
+        if (savedK < 8 || levelCount == 0 || levelCount > 64) return false;
+        k = savedK;
+        levels.assign(levelCount, std::vector<int>());
+        for (std::vector<int>& items : levels) {
+            std::uint32_t itemCount;
+            if (!readValue(in, itemCount) || itemCount > 64 * k) return false;
+            items.resize(itemCount);
+            if (!in.read(reinterpret_cast<char*>(items.data()), itemCount * sizeof(int))) return false;
+        }
+        return true;
+    }
+};
+
+// Space-Saving top-K (Metwally et al. 2005) over at most capacity keys. A new key
+// takes over the smallest counter and inherits its count as error, so each count
+// overestimates the true one by at most its error. Every tracked key also keeps a
+// quantile sketch and a distinct count of the values seen while it was tracked.
+class SpaceSaving {
+public:
+    struct Counter {
+        int key;
+        std::uint64_t count;
+        std::uint64_t error;
+        KllSketch values;
+        HyperLogLog distinctValues;
+    };
+
+private:
+    std::size_t capacity;
+    std::vector<Counter> heap; // min-heap on count
+    std::unordered_map<int, std::size_t> positions; // key -> index in heap
+
+    void swapCounters(std::size_t a, std::size_t b) {
+        std::swap(heap[a], heap[b]);
+        positions[heap[a].key] = a;
+        positions[heap[b].key] = b;
+    }
+
+    void siftDown(std::size_t index) {
+        while (true) {
+            std::size_t smallest = index;
+            std::size_t left = 2 * index + 1;
+            std::size_t right = left + 1;
+            if (left < heap.size() && heap[left].count < heap[smallest].count) smallest = left;
+            if (right < heap.size() && heap[right].count < heap[smallest].count) smallest = right;
+            if (smallest == index) return;
+            swapCounters(index, smallest);
+            index = smallest;
+        }
+    }
+
+    void siftUp(std::size_t index) {
+        while (index > 0) {
+            std::size_t parent = (index - 1) / 2;
+            if (heap[parent].count <= heap[index].count) return;
+            swapCounters(index, parent);
+            index = parent;
+        }
+    }
+
+    void insert(Counter counter) {
+        positions[counter.key] = heap.size();
+        heap.push_back(std::move(counter));
+        siftUp(heap.size() - 1);
+    }
+
+    // Count a summary assigns to a key it does not track
+    std::uint64_t floorCount() const {
+        return heap.size() < capacity || heap.empty() ? 0 : heap[0].count;
+    }
+
+public:
+    explicit SpaceSaving(std::size_t capacity = DEFAULT_HEAVY_KEYS) : capacity(std::max<std::size_t>(capacity, 1)) {}
+
+    void add(int key, int value) {
+        auto found = positions.find(key);
+        if (found != positions.end()) {
+            Counter& counter = heap[found->second];
+            counter.count++;
+            counter.values.add(value);
+            counter.distinctValues.add(value);
+            siftDown(found->second);
+            return;
+        }
+        if (heap.size() < capacity) {
+            Counter counter{key, 1, 0, KllSketch(KEY_KLL_K), HyperLogLog(KEY_HLL_PRECISION)};
+            counter.values.add(value);
+            counter.distinctValues.add(value);
+            insert(std::move(counter));
+            return;
+        }
+        Counter& smallest = heap[0];
+        positions.erase(smallest.key);
+        smallest.key = key;
+        smallest.error = smallest.count;
+        smallest.count++;
+        smallest.values.clear();
+        smallest.values.add(value);
+        smallest.distinctValues.clear();
+        smallest.distinctValues.add(value);
+        positions[key] = 0;
+        siftDown(0);
+    }
+
+    // Mergeable summaries merge (Agarwal et al. 2012): a key missing from one side
+    // is charged that side's smallest count, then the largest counters are kept
+    void merge(const SpaceSaving& other) {
+        std::uint64_t ownFloor = floorCount();
+        std::uint64_t otherFloor = other.floorCount();
+        std::vector<Counter> combined;
+        for (Counter& counter : heap) {
+            auto found = other.positions.find(counter.key);
+            if (found != other.positions.end()) {
+                const Counter& match = other.heap[found->second];
+                counter.count += match.count;
+                counter.error += match.error;
+                counter.values.merge(match.values);
+                counter.distinctValues.merge(match.distinctValues);
+            }
+            else {
+                counter.count += otherFloor;
+                counter.error += otherFloor;
+            }
+            combined.push_back(std::move(counter));
+        }
+        for (const Counter& counter : other.heap) {
+            if (positions.count(counter.key)) continue;
+            combined.push_back(Counter{counter.key, counter.count + ownFloor, counter.error + ownFloor,
+                counter.values, counter.distinctValues});
+        }
+
+        std::sort(combined.begin(), combined.end(),
+            [](const Counter& a, const Counter& b) { return a.count > b.count; });
+        if (combined.size() > capacity) combined.resize(capacity);
+        heap.clear();
+        positions.clear();
+        for (Counter& counter : combined) {
+            insert(std::move(counter));
+        }
+    }
+
+    // Tracked keys, largest count first
+    std::vector<const Counter*> top(std::size_t limit) const {
+        std::vector<const Counter*> counters;
+        for (const Counter& counter : heap) {
+            counters.push_back(&counter);
+        }
+        std::sort(counters.begin(), counters.end(),
+            [](const Counter* a, const Counter* b) { return a->count > b->count; });
+        if (counters.size() > limit) counters.resize(limit);
+        return counters;
+    }
+
+    void save(std::ostream& out) const {
+        writeValue(out, (std::uint32_t)capacity);
+        writeValue(out, (std::uint32_t)heap.size());
+        for (const Counter& counter : heap) {
+            writeValue(out, counter.key);
+            writeValue(out, counter.count);
+            writeValue(out, counter.error);
+            counter.values.save(out);
+            counter.distinctValues.save(out);
+        }
+    }
+
+    // Counters saved without distinct counts, by older checkpoints, load with empty ones
+    bool load(std::istream& in, bool withDistinctValues = true) {
+        std::uint32_t savedCapacity, counterCount;
+        if (!readValue(in, savedCapacity) || !readValue(in, counterCount)) return false;
+        if (savedCapacity == 0 || counterCount > savedCapacity) return false;
+        capacity = savedCapacity;
+        heap.clear();
+        positions.clear();
+        for (std::uint32_t i = 0; i < counterCount; i++) {
+            Counter counter{0, 0, 0, KllSketch(KEY_KLL_K), HyperLogLog(KEY_HLL_PRECISION)};
+            if (!readValue(in, counter.key) || !readValue(in, counter.count) || !readValue(in, counter.error)
+                || !counter.values.load(in) || (withDistinctValues && !counter.distinctValues.load(in))) return false;
+            insert(std::move(counter));
+        }
+        return true;
+    }
+};
+
+// Bounded-memory summary of a key,value stream: distinct keys and values, value
+// quantiles and the heaviest keys with their own value quantiles
+struct SketchSet {
+    HyperLogLog distinctKeys;
+    HyperLogLog distinctValues;
+    KllSketch values;
+    SpaceSaving heavyKeys;
+
+    explicit SketchSet(std::size_t heavyKeyCapacity = DEFAULT_HEAVY_KEYS) : heavyKeys(heavyKeyCapacity) {}
+
+    void add(int key, int value) {
+        distinctKeys.add(key);
+        distinctValues.add(value);
+        values.add(value);
+        heavyKeys.add(key, value);
+    }
+
+    void merge(const SketchSet& other) {
+        distinctKeys.merge(other.distinctKeys);
+        distinctValues.merge(other.distinctValues);
+        values.merge(other.values);
+        heavyKeys.merge(other.heavyKeys);
+    }
+
+    void save(std::ostream& out) const {
+        distinctKeys.save(out);
+        distinctValues.save(out);
+        values.save(out);
+        heavyKeys.save(out);
+    }
+
+    bool load(std::istream& in, bool withKeyDistinctValues = true) {
+        return distinctKeys.load(in) && distinctValues.load(in) && values.load(in)
+            && heavyKeys.load(in, withKeyDistinctValues);
+    }
+};
+
+#endif
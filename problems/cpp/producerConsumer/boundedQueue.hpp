@@ -0,0 +1,582 @@
+#ifndef BOUNDEDQUEUE_HPP
+#define BOUNDEDQUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+constexpr int SPIN_LIMIT = 128; // busy polls before yielding
+constexpr int YIELD_LIMIT = 16; // yields before parking
+
+enum class QueueKind {
+    MUTEX, // any number of producers and consumers, blocking waits on condition variables
+    SPSC, // exactly one producer thread and one consumer thread, lock-free
+    MPMC // any number of producers and consumers, lock-free
+};
+
+// Interface shared by every implementation. push/pop block until they succeed,
+// tryPush/tryPop return false instead. pushN moves every item in, popN appends
+// at least one and at most maxCount items. size() is exact only for MUTEX.
+template <typename Q, typename T>
+concept BoundedQueueInterface = requires(Q queue, T value, T& out, std::span<T> batch, std::vector<T>& drained) {
+    { queue.tryPush(std::move(value)) } -> std::same_as<bool>;
+    { queue.tryPop(out) } -> std::same_as<bool>;
+    queue.push(std::move(value));
+    { queue.pop() } -> std::same_as<T>;
+    { queue.tryPushN(batch) } -> std::same_as<std::size_t>;
+    { queue.tryPopN(drained, std::size_t()) } -> std::same_as<std::size_t>;
+    queue.pushN(batch);
+    { queue.popN(drained, std::size_t()) } -> std::same_as<std::size_t>;
+    { queue.size() } -> std::same_as<std::size_t>;
+    { queue.capacity() } -> std::same_as<std::size_t>;
+};
+
+inline std::size_t roundUpToPowerOfTwo(std::size_t value) {
+    std::size_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// First two phases of an adaptive wait; false means the caller should park
+template <typename Ready>
+bool spinThenYield(Ready&& ready) {
+    for (int i = 0; i < SPIN_LIMIT; i++) {
+        if (ready()) return true;
+        cpuRelax();
+    }
+    for (int i = 0; i < YIELD_LIMIT; i++) {
+        if (ready()) return true;
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+// Spin, then yield, then park on a futex-backed atomic. notify() is a fence and
+// a load unless a thread is actually parked, so the fast path makes no syscall.
+class AdaptiveWaiter {
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<std::uint32_t> epoch;
+    std::atomic<std::uint32_t> sleepers;
+
+public:
+    AdaptiveWaiter() : epoch(0), sleepers(0) {}
+
+    // ready() is retried until it returns true; it may have side effects such as popping
+    template <typename Ready>
+    void waitUntil(Ready&& ready) {
+        if (spinThenYield(ready)) return;
+
+        while (true) {
+            std::uint32_t observed = epoch.load(std::memory_order_acquire);
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            if (ready()) {
+                sleepers.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+            epoch.wait(observed, std::memory_order_acquire);
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (ready()) return;
+        }
+    }
+
+    // Call after the state change ready() looks for
+    void notify(bool all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the sleepers increment
+        if (sleepers.load(std::memory_order_relaxed) == 0) return;
+
+        epoch.fetch_add(1, std::memory_order_release);
+        if (all) epoch.notify_all();
+        else epoch.notify_one();
+    }
+};
+
+// Producers and consumers wait on separate condition variables and are only
+// signalled while one of them is parked. Waiters spin on count before locking.
+template <typename T>
+class MutexBoundedQueue {
+private:
+    std::deque<T> items;
+    std::size_t maxSize;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> count; // mirrors items.size() for spinning waiters
+    std::size_t waitingProducers;
+    std::size_t waitingConsumers;
+    mutable std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+    // Caller holds mtx; the result says whether to signal after unlocking
+    bool pushedLocked() {
+        count.store(items.size(), std::memory_order_relaxed);
+        return waitingConsumers > 0;
+    }
+
+    bool poppedLocked() {
+        count.store(items.size(), std::memory_order_relaxed);
+        return waitingProducers > 0;
+    }
+
+    void waitNotFull(std::unique_lock<std::mutex>& lock) {
+        if (items.size() < maxSize) return;
+        lock.unlock();
+        spinThenYield([this] { return count.load(std::memory_order_relaxed) < maxSize; });
+        lock.lock();
+        waitingProducers++;
+        notFull.wait(lock, [this] { return items.size() < maxSize; });
+        waitingProducers--;
+    }
+
+    void waitNotEmpty(std::unique_lock<std::mutex>& lock) {
+        if (!items.empty()) return;
+        lock.unlock();
+        spinThenYield([this] { return count.load(std::memory_order_relaxed) > 0; });
+        lock.lock();
+        waitingConsumers++;
+        notEmpty.wait(lock, [this] { return !items.empty(); });
+        waitingConsumers--;
+    }
+
+public:
+    explicit MutexBoundedQueue(std::size_t capacity)
+        : maxSize(capacity > 0 ? capacity : 1), count(0), waitingProducers(0), waitingConsumers(0) {}
+    MutexBoundedQueue(const MutexBoundedQueue&) = delete;
+    MutexBoundedQueue& operator=(const MutexBoundedQueue&) = delete;
+
+    // The value is only moved from when the push succeeds
+    template <typename U>
+    bool tryPush(U&& value) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (items.size() >= maxSize) return false;
+            items.push_back(std::forward<U>(value));
+            wake = pushedLocked();
+        }
+        if (wake) notEmpty.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (items.empty()) return false;
+            value = std::move(items.front());
+            items.pop_front();
+            wake = poppedLocked();
+        }
+        if (wake) notFull.notify_one();
+        return true;
+    }
+
+    template <typename U>
+    void push(U&& value) {
+        std::unique_lock<std::mutex> lock(mtx);
+        waitNotFull(lock);
+        items.push_back(std::forward<U>(value));
+        bool wake = pushedLocked();
+        lock.unlock();
+        if (wake) notEmpty.notify_one();
+    }
+
+    T pop() {
+        std::unique_lock<std::mutex> lock(mtx);
+        waitNotEmpty(lock);
+        T value = std::move(items.front());
+        items.pop_front();
+        bool wake = poppedLocked();
+        lock.unlock();
+        if (wake) notFull.notify_one();
+        return value;
+    }
+
+    // Moves the longest prefix of batch that fits, under a single lock
+    std::size_t tryPushN(std::span<T> batch) {
+        std::size_t pushed;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pushed = std::min(batch.size(), maxSize - items.size());
+            for (std::size_t i = 0; i < pushed; i++) {
+                items.push_back(std::move(batch[i]));
+            }
+            wake = pushed > 0 && pushedLocked();
+        }
+        if (wake) notEmpty.notify_all();
+        return pushed;
+    }
+
+    std::size_t tryPopN(std::vector<T>& out, std::size_t maxCount) {
+        std::size_t popped;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            popped = std::min(maxCount, items.size());
+            for (std::size_t i = 0; i < popped; i++) {
+                out.push_back(std::move(items.front()));
+                items.pop_front();
+            }
+            wake = popped > 0 && poppedLocked();
+        }
+        if (wake) notFull.notify_all();
+        return popped;
+    }
+
+    void pushN(std::span<T> batch) {
+        std::size_t pushed = 0;
+        std::unique_lock<std::mutex> lock(mtx);
+        while (pushed < batch.size()) {
+            waitNotFull(lock);
+            while (pushed < batch.size() && items.size() < maxSize) {
+                items.push_back(std::move(batch[pushed++]));
+            }
+            if (pushedLocked()) {
+                lock.unlock();
+                notEmpty.notify_all();
+                lock.lock();
+            }
+        }
+    }
+
+    std::size_t popN(std::vector<T>& out, std::size_t maxCount) {
+        if (maxCount == 0) return 0;
+
+        std::unique_lock<std::mutex> lock(mtx);
+        waitNotEmpty(lock);
+        std::size_t popped = std::min(maxCount, items.size());
+        for (std::size_t i = 0; i < popped; i++) {
+            out.push_back(std::move(items.front()));
+            items.pop_front();
+        }
+        bool wake = poppedLocked();
+        lock.unlock();
+        if (wake) notFull.notify_all();
+        return popped;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return items.size();
+    }
+
+    std::size_t capacity() const { return maxSize; }
+};
+
+// Lamport ring with each index on its own cache line. Each side caches the
+// other side's index and only reloads it when the ring looks full or empty.
+template <typename T>
+class SpscBoundedQueue {
+private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* get() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    Slot* slots;
+    std::size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head; // next slot to pop, written by the consumer
+    std::size_t cachedTail; // consumer's view of tail
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail; // next slot to push, written by the producer
+    std::size_t cachedHead; // producer's view of head
+    AdaptiveWaiter notFull;
+    AdaptiveWaiter notEmpty;
+
+    std::size_t freeSlots(std::size_t position) {
+        std::size_t available = mask + 1 - (position - cachedHead);
+        if (available == 0) {
+            cachedHead = head.load(std::memory_order_acquire);
+            available = mask + 1 - (position - cachedHead);
+        }
+        return available;
+    }
+
+    std::size_t readySlots(std::size_t position) {
+        if (position == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+        }
+        return cachedTail - position;
+    }
+
+    // Hands up to maxCount front elements to sink, destroying each in place
+    template <typename Sink>
+    std::size_t consume(Sink&& sink, std::size_t maxCount) {
+        std::size_t position = head.load(std::memory_order_relaxed);
+        std::size_t n = std::min(maxCount, readySlots(position));
+        if (n == 0) return 0;
+
+        for (std::size_t i = 0; i < n; i++) {
+            T* item = slots[(position + i) & mask].get();
+            sink(std::move(*item));
+            item->~T();
+        }
+        head.store(position + n, std::memory_order_release);
+        notFull.notify(false);
+        return n;
+    }
+
+    // Publishes everything produced with a single tail store
+    template <typename Source>
+    std::size_t produce(Source&& source, std::size_t count) {
+        std::size_t position = tail.load(std::memory_order_relaxed);
+        std::size_t n = std::min(count, freeSlots(position));
+        if (n == 0) return 0;
+
+        for (std::size_t i = 0; i < n; i++) {
+            source(slots[(position + i) & mask].storage, i);
+        }
+        tail.store(position + n, std::memory_order_release);
+        notEmpty.notify(false);
+        return n;
+    }
+
+public:
+    explicit SpscBoundedQueue(std::size_t capacity)
+        : slots(new Slot[roundUpToPowerOfTwo(capacity > 0 ? capacity : 1)]),
+          mask(roundUpToPowerOfTwo(capacity > 0 ? capacity : 1) - 1),
+          head(0), cachedTail(0), tail(0), cachedHead(0) {}
+
+    ~SpscBoundedQueue() {
+        while (consume([](T&&) {}, SIZE_MAX) > 0) {}
+        delete[] slots;
+    }
+
+    SpscBoundedQueue(const SpscBoundedQueue&) = delete;
+    SpscBoundedQueue& operator=(const SpscBoundedQueue&) = delete;
+
+    template <typename U>
+    bool tryPush(U&& value) {
+        return produce([&value](void* storage, std::size_t) { new (storage) T(std::forward<U>(value)); }, 1) > 0;
+    }
+
+    bool tryPop(T& value) {
+        return consume([&value](T&& item) { value = std::move(item); }, 1) > 0;
+    }
+
+    template <typename U>
+    void push(U&& value) {
+        notFull.waitUntil([&] { return tryPush(std::forward<U>(value)); });
+    }
+
+    T pop() {
+        std::optional<T> value;
+        notEmpty.waitUntil([&] { return consume([&value](T&& item) { value.emplace(std::move(item)); }, 1) > 0; });
+        return std::move(*value);
+    }
+
+    std::size_t tryPushN(std::span<T> batch) {
+        return produce([&batch](void* storage, std::size_t i) { new (storage) T(std::move(batch[i])); },
+            batch.size());
+    }
+
+    std::size_t tryPopN(std::vector<T>& out, std::size_t maxCount) {
+        return consume([&out](T&& item) { out.push_back(std::move(item)); }, maxCount);
+    }
+
+    void pushN(std::span<T> batch) {
+        std::size_t pushed = tryPushN(batch);
+        if (pushed == batch.size()) return;
+        notFull.waitUntil([&] {
+            pushed += tryPushN(batch.subspan(pushed));
+            return pushed == batch.size();
+        });
+    }
+
+    std::size_t popN(std::vector<T>& out, std::size_t maxCount) {
+        if (maxCount == 0) return 0;
+
+        std::size_t popped = 0;
+        notEmpty.waitUntil([&] {
+            popped = tryPopN(out, maxCount);
+            return popped > 0;
+        });
+        return popped;
+    }
+
+    std::size_t size() const {
+        std::size_t first = head.load(std::memory_order_acquire);
+        std::size_t last = tail.load(std::memory_order_acquire);
+        return last > first ? last - first : 0;
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+};
+
+// Vyukov bounded ring: each cell's sequence number tells producers and
+// consumers whether it is free or full for the lap they are on.
+template <typename T>
+class MpmcBoundedQueue {
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* get() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    Cell* cells;
+    std::size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> enqueuePos;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> dequeuePos;
+    AdaptiveWaiter notFull;
+    AdaptiveWaiter notEmpty;
+
+    // Claims up to maxCount consecutive full cells with a single CAS
+    template <typename Sink>
+    std::size_t consume(Sink&& sink, std::size_t maxCount) {
+        std::size_t n;
+        std::size_t position = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            n = 0;
+            while (n < maxCount
+                && cells[(position + n) & mask].sequence.load(std::memory_order_acquire) == position + n + 1) {
+                n++;
+            }
+            if (n == 0) {
+                std::size_t sequence = cells[position & mask].sequence.load(std::memory_order_acquire);
+                if ((std::ptrdiff_t)sequence - (std::ptrdiff_t)(position + 1) < 0) return 0; // empty
+                position = dequeuePos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (dequeuePos.compare_exchange_weak(position, position + n, std::memory_order_relaxed)) break;
+        }
+        for (std::size_t i = 0; i < n; i++) {
+            Cell& cell = cells[(position + i) & mask];
+            T* item = cell.get();
+            sink(std::move(*item));
+            item->~T();
+            cell.sequence.store(position + i + mask + 1, std::memory_order_release);
+        }
+        notFull.notify(n > 1);
+        return n;
+    }
+
+    // Claims up to count consecutive free cells with a single CAS, then fills them from source
+    template <typename Source>
+    std::size_t produce(Source&& source, std::size_t count) {
+        std::size_t n;
+        std::size_t position = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            n = 0;
+            while (n < count && cells[(position + n) & mask].sequence.load(std::memory_order_acquire) == position + n) {
+                n++;
+            }
+            if (n == 0) {
+                std::size_t sequence = cells[position & mask].sequence.load(std::memory_order_acquire);
+                if ((std::ptrdiff_t)sequence - (std::ptrdiff_t)position < 0) return 0; // full
+                position = enqueuePos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (enqueuePos.compare_exchange_weak(position, position + n, std::memory_order_relaxed)) break;
+        }
+        for (std::size_t i = 0; i < n; i++) {
+            Cell& cell = cells[(position + i) & mask];
+            source(cell.storage, i);
+            cell.sequence.store(position + i + 1, std::memory_order_release);
+        }
+        notEmpty.notify(n > 1);
+        return n;
+    }
+
+public:
+    explicit MpmcBoundedQueue(std::size_t capacity)
+        : cells(new Cell[roundUpToPowerOfTwo(capacity > 1 ? capacity : 2)]),
+          mask(roundUpToPowerOfTwo(capacity > 1 ? capacity : 2) - 1),
+          enqueuePos(0), dequeuePos(0) {
+        for (std::size_t i = 0; i <= mask; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcBoundedQueue() {
+        while (consume([](T&&) {}, SIZE_MAX) > 0) {}
+        delete[] cells;
+    }
+
+    MpmcBoundedQueue(const MpmcBoundedQueue&) = delete;
+    MpmcBoundedQueue& operator=(const MpmcBoundedQueue&) = delete;
+
+    template <typename U>
+    bool tryPush(U&& value) {
+        return produce([&value](void* storage, std::size_t) { new (storage) T(std::forward<U>(value)); }, 1) > 0;
+    }
+
+    bool tryPop(T& value) {
+        return consume([&value](T&& item) { value = std::move(item); }, 1) > 0;
+    }
+
+    template <typename U>
+    void push(U&& value) {
+        notFull.waitUntil([&] { return tryPush(std::forward<U>(value)); });
+    }
+
+    T pop() {
+        std::optional<T> value;
+        notEmpty.waitUntil([&] { return consume([&value](T&& item) { value.emplace(std::move(item)); }, 1) > 0; });
+        return std::move(*value);
+    }
+
+    std::size_t tryPushN(std::span<T> batch) {
+        return produce([&batch](void* storage, std::size_t i) { new (storage) T(std::move(batch[i])); },
+            batch.size());
+    }
+
+    std::size_t tryPopN(std::vector<T>& out, std::size_t maxCount) {
+        return consume([&out](T&& item) { out.push_back(std::move(item)); }, maxCount);
+    }
+
+    void pushN(std::span<T> batch) {
+        std::size_t pushed = tryPushN(batch);
+        if (pushed == batch.size()) return;
+        notFull.waitUntil([&] {
+            pushed += tryPushN(batch.subspan(pushed));
+            return pushed == batch.size();
+        });
+    }
+
+    std::size_t popN(std::vector<T>& out, std::size_t maxCount) {
+        if (maxCount == 0) return 0;
+
+        std::size_t popped = 0;
+        notEmpty.waitUntil([&] {
+            popped = tryPopN(out, maxCount);
+            return popped > 0;
+        });
+        return popped;
+    }
+
+    std::size_t size() const {
+        std::size_t first = dequeuePos.load(std::memory_order_acquire);
+        std::size_t last = enqueuePos.load(std::memory_order_acquire);
+        return last > first ? last - first : 0;
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+};
+
+// BoundedQueue<T, QueueKind::MPMC> picks an implementation; all of them satisfy BoundedQueueInterface
+template <typename T, QueueKind Kind = QueueKind::MUTEX>
+using BoundedQueue = std::conditional_t<Kind == QueueKind::MUTEX, MutexBoundedQueue<T>,
+    std::conditional_t<Kind == QueueKind::SPSC, SpscBoundedQueue<T>, MpmcBoundedQueue<T>>>;
+
+#endif
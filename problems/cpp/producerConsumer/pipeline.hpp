@@ -0,0 +1,437 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "boundedQueue.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+constexpr std::size_t DEFAULT_STAGE_QUEUE_CAPACITY = 1024;
+
+enum class Ordering {
+    RELAXED, // results leave in completion order
+    PRESERVED // results leave in source order, via a reorder buffer bounded by the queue capacity
+};
+
+// Counters of one stage; compare utilization across stages to find the one to scale
+struct StageStats {
+    std::string name;
+    std::size_t workers = 0;
+    std::uint64_t items = 0;
+    double busySeconds = 0; // inside the stage function, summed over workers
+    double inputWaitSeconds = 0; // starved: waiting for upstream
+    double outputBlockedSeconds = 0; // backpressure: waiting for room downstream
+    std::size_t queueDepth = 0; // items waiting in the stage's input queue
+    double utilization = 0; // busySeconds / (workers * elapsed)
+};
+
+template <typename T>
+struct Envelope {
+    std::uint64_t sequence = 0;
+    std::optional<T> value; // empty for end of stream, or for items skipped after a failure
+    bool end = false;
+};
+
+template <typename T>
+using Channel = MpmcBoundedQueue<Envelope<T>>;
+
+inline std::int64_t pipelineNowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// First stage failure; later stages skip work and the source stops early
+class PipelineControl {
+private:
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    std::mutex mtx;
+
+public:
+    PipelineControl() : failed(false) {}
+
+    bool hasFailed() const { return failed.load(std::memory_order_relaxed); }
+
+    void fail(std::exception_ptr exception) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!error) error = exception;
+        failed.store(true, std::memory_order_relaxed);
+    }
+
+    void rethrowIfFailed() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+class StageBase {
+protected:
+    std::string name;
+    std::size_t workerCount;
+    std::size_t downstreamWorkers; // end markers to send when this stage finishes
+    PipelineControl& control;
+    std::atomic<std::uint64_t> items;
+    std::atomic<std::int64_t> busyNanos;
+    std::atomic<std::int64_t> inputWaitNanos;
+    std::atomic<std::int64_t> outputBlockedNanos;
+
+    template <typename T>
+    void timedPush(Channel<T>& channel, Envelope<T> envelope) {
+        std::int64_t start = pipelineNowNanos();
+        channel.push(std::move(envelope));
+        outputBlockedNanos.fetch_add(pipelineNowNanos() - start, std::memory_order_relaxed);
+    }
+
+    template <typename T>
+    void sendEnd(Channel<T>& channel) {
+        for (std::size_t i = 0; i < downstreamWorkers; i++) {
+            Envelope<T> marker;
+            marker.end = true;
+            timedPush(channel, std::move(marker));
+        }
+    }
+
+    template <typename T>
+    Envelope<T> timedPop(Channel<T>& channel) {
+        std::int64_t start = pipelineNowNanos();
+        Envelope<T> envelope = channel.pop();
+        inputWaitNanos.fetch_add(pipelineNowNanos() - start, std::memory_order_relaxed);
+        return envelope;
+    }
+
+public:
+    StageBase(std::string name, std::size_t workerCount, PipelineControl& control)
+        : name(std::move(name)), workerCount(workerCount > 0 ? workerCount : 1), downstreamWorkers(0),
+          control(control), items(0), busyNanos(0), inputWaitNanos(0), outputBlockedNanos(0) {}
+    virtual ~StageBase() = default;
+    StageBase(const StageBase&) = delete;
+    StageBase& operator=(const StageBase&) = delete;
+
+    std::size_t getWorkerCount() const { return workerCount; }
+    void setDownstreamWorkers(std::size_t count) { downstreamWorkers = count; }
+
+    virtual void start(std::vector<std::thread>& threads) = 0;
+    virtual std::size_t getQueueDepth() const = 0;
+
+    StageStats getStats(double elapsedSeconds) const {
+        StageStats stats;
+        stats.name = name;
+        stats.workers = workerCount;
+        stats.items = items.load(std::memory_order_relaxed);
+        stats.busySeconds = busyNanos.load(std::memory_order_relaxed) / 1e9;
+        stats.inputWaitSeconds = inputWaitNanos.load(std::memory_order_relaxed) / 1e9;
+        stats.outputBlockedSeconds = outputBlockedNanos.load(std::memory_order_relaxed) / 1e9;
+        stats.queueDepth = getQueueDepth();
+        stats.utilization = elapsedSeconds > 0 ? stats.busySeconds / (workerCount * elapsedSeconds) : 0;
+        return stats;
+    }
+};
+
+// Pulls items from F until it returns an empty optional; blocks when the first queue is full
+template <typename T, typename F>
+class SourceStage : public StageBase {
+private:
+    F generate;
+    Channel<T>& output;
+
+    void run() {
+        std::uint64_t sequence = 0;
+        while (!control.hasFailed()) {
+            std::optional<T> value;
+            std::int64_t start = pipelineNowNanos();
+            try {
+                value = generate();
+            }
+            catch (...) {
+                control.fail(std::current_exception());
+            }
+            busyNanos.fetch_add(pipelineNowNanos() - start, std::memory_order_relaxed);
+            if (!value) break;
+
+            items.fetch_add(1, std::memory_order_relaxed);
+            timedPush(output, Envelope<T>{sequence++, std::move(value), false});
+        }
+        sendEnd(output);
+    }
+
+public:
+    SourceStage(std::string name, PipelineControl& control, F generate, Channel<T>& output)
+        : StageBase(std::move(name), 1, control), generate(std::move(generate)), output(output) {}
+
+    void start(std::vector<std::thread>& threads) override {
+        threads.emplace_back([this] { run(); });
+    }
+
+    std::size_t getQueueDepth() const override { return 0; }
+};
+
+// Applies F to every item on workerCount threads. The last worker to see its
+// end marker forwards end markers, so nothing is emitted after them.
+// PRESERVED workers stop taking input once they are a full window ahead of the
+// next item to leave, so a slow item holds back its stage instead of filling the
+// reorder buffer. Only one worker emits at a time, outside the lock.
+template <typename In, typename Out, typename F>
+class TransformStage : public StageBase {
+private:
+    F transform;
+    Ordering ordering;
+    Channel<In>& input;
+    Channel<Out>& output;
+    std::atomic<std::size_t> finishedWorkers;
+    std::size_t windowSize;
+    std::mutex reorderMutex;
+    std::condition_variable windowCond;
+    std::map<std::uint64_t, Envelope<Out>> reorderBuffer; // guarded by reorderMutex
+    std::vector<std::uint64_t> working; // sequences inside transform, guarded by reorderMutex
+    std::uint64_t nextSequence; // next to leave, guarded by reorderMutex
+    bool emitting; // a worker is pushing ready results, guarded by reorderMutex
+
+    bool isWorking(std::uint64_t sequence) const {
+        return std::find(working.begin(), working.end(), sequence) != working.end();
+    }
+
+    // Waiting only helps while the next item to leave is being worked on here. A
+    // RELAXED stage upstream can hold it back behind later items; blocking then
+    // would stop this stage from ever receiving it, so those items are buffered.
+    void admit(std::uint64_t sequence) {
+        std::unique_lock<std::mutex> lock(reorderMutex);
+        working.push_back(sequence);
+        windowCond.wait(lock, [this, sequence] {
+            return sequence - nextSequence < windowSize || !isWorking(nextSequence);
+        });
+    }
+
+    void forward(Envelope<Out> envelope) {
+        if (ordering == Ordering::RELAXED) {
+            timedPush(output, std::move(envelope));
+            return;
+        }
+
+        std::vector<Envelope<Out>> ready;
+        std::unique_lock<std::mutex> lock(reorderMutex);
+        working.erase(std::find(working.begin(), working.end(), envelope.sequence));
+        reorderBuffer.emplace(envelope.sequence, std::move(envelope));
+        if (emitting) return; // the emitting worker picks it up before it stops
+        emitting = true;
+        while (true) {
+            while (!reorderBuffer.empty() && reorderBuffer.begin()->first == nextSequence) {
+                ready.push_back(std::move(reorderBuffer.begin()->second));
+                reorderBuffer.erase(reorderBuffer.begin());
+                nextSequence++;
+            }
+            if (ready.empty()) {
+                emitting = false;
+                return;
+            }
+            windowCond.notify_all();
+            lock.unlock();
+            for (Envelope<Out>& result : ready) {
+                timedPush(output, std::move(result));
+            }
+            ready.clear();
+            lock.lock();
+        }
+    }
+
+    void run() {
+        while (true) {
+            Envelope<In> envelope = timedPop(input);
+            if (envelope.end) break;
+            if (ordering == Ordering::PRESERVED) admit(envelope.sequence);
+
+            Envelope<Out> result;
+            result.sequence = envelope.sequence;
+            if (envelope.value && !control.hasFailed()) {
+                std::int64_t start = pipelineNowNanos();
+                try {
+                    result.value.emplace(transform(std::move(*envelope.value)));
+                    items.fetch_add(1, std::memory_order_relaxed);
+                }
+                catch (...) {
+                    control.fail(std::current_exception());
+                }
+                busyNanos.fetch_add(pipelineNowNanos() - start, std::memory_order_relaxed);
+            }
+            forward(std::move(result)); // skipped items still advance the reorder buffer
+        }
+        if (finishedWorkers.fetch_add(1, std::memory_order_acq_rel) + 1 == workerCount) {
+            sendEnd(output);
+        }
+    }
+
+public:
+    TransformStage(std::string name, std::size_t workers, Ordering ordering, PipelineControl& control,
+        std::size_t windowSize, F transform, Channel<In>& input, Channel<Out>& output)
+        : StageBase(std::move(name), workers, control), transform(std::move(transform)), ordering(ordering),
+          input(input), output(output), finishedWorkers(0), windowSize(windowSize > 0 ? windowSize : 1),
+          nextSequence(0), emitting(false) {}
+
+    void start(std::vector<std::thread>& threads) override {
+        for (std::size_t i = 0; i < workerCount; i++) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    std::size_t getQueueDepth() const override { return input.size(); }
+};
+
+template <typename T, typename F>
+class SinkStage : public StageBase {
+private:
+    F consume;
+    Channel<T>& input;
+
+    void run() {
+        while (true) {
+            Envelope<T> envelope = timedPop(input);
+            if (envelope.end) break;
+            if (!envelope.value || control.hasFailed()) continue;
+
+            std::int64_t start = pipelineNowNanos();
+            try {
+                consume(std::move(*envelope.value));
+                items.fetch_add(1, std::memory_order_relaxed);
+            }
+            catch (...) {
+                control.fail(std::current_exception());
+            }
+            busyNanos.fetch_add(pipelineNowNanos() - start, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    SinkStage(std::string name, std::size_t workers, PipelineControl& control, F consume, Channel<T>& input)
+        : StageBase(std::move(name), workers, control), consume(std::move(consume)), input(input) {}
+
+    void start(std::vector<std::thread>& threads) override {
+        for (std::size_t i = 0; i < workerCount; i++) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    std::size_t getQueueDepth() const override { return input.size(); }
+};
+
+class Pipeline {
+private:
+    PipelineControl control;
+    std::vector<std::shared_ptr<void>> channels; // type-erased owners of the queues between stages
+    std::vector<std::unique_ptr<StageBase>> stages;
+    std::size_t queueCapacity;
+    std::atomic<std::int64_t> startNanos;
+    std::atomic<std::int64_t> endNanos;
+
+    template <typename T>
+    friend class PipelineBuilder;
+
+    template <typename T>
+    Channel<T>& addChannel() {
+        auto channel = std::make_shared<Channel<T>>(queueCapacity);
+        channels.push_back(channel);
+        return *channel;
+    }
+
+public:
+    explicit Pipeline(std::size_t queueCapacity) : queueCapacity(queueCapacity), startNanos(0), endNanos(0) {}
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // Runs every stage to completion on its own threads; rethrows the first stage failure
+    void run() {
+        std::vector<std::thread> threads;
+        startNanos.store(pipelineNowNanos(), std::memory_order_relaxed);
+        for (std::unique_ptr<StageBase>& stage : stages) {
+            stage->start(threads);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        endNanos.store(pipelineNowNanos(), std::memory_order_relaxed);
+        control.rethrowIfFailed();
+    }
+
+    // Safe to call from another thread while run() is in progress
+    std::vector<StageStats> getStats() const {
+        std::int64_t start = startNanos.load(std::memory_order_relaxed);
+        std::int64_t end = endNanos.load(std::memory_order_relaxed);
+        double elapsed = start == 0 ? 0 : ((end != 0 ? end : pipelineNowNanos()) - start) / 1e9;
+
+        std::vector<StageStats> stats;
+        for (const std::unique_ptr<StageBase>& stage : stages) {
+            stats.push_back(stage->getStats(elapsed));
+        }
+        return stats;
+    }
+
+    // The busiest stage per worker; adding workers there raises throughput
+    std::string getBottleneck() const {
+        std::vector<StageStats> stats = getStats();
+        const StageStats* busiest = nullptr;
+        for (const StageStats& stage : stats) {
+            if (!busiest || stage.utilization > busiest->utilization) busiest = &stage;
+        }
+        return busiest ? busiest->name : std::string();
+    }
+};
+
+// Typed builder: source -> stage x N -> sink. Each call adds one stage and a bounded queue.
+template <typename T>
+class PipelineBuilder {
+private:
+    std::unique_ptr<Pipeline> pipeline;
+    Channel<T>* output; // read by the next stage
+    StageBase* producer; // writes output
+
+    template <typename U>
+    friend class PipelineBuilder;
+
+    PipelineBuilder(std::unique_ptr<Pipeline> pipeline, Channel<T>* output, StageBase* producer)
+        : pipeline(std::move(pipeline)), output(output), producer(producer) {}
+
+public:
+    template <typename F>
+    static PipelineBuilder source(std::string name, F generate,
+        std::size_t queueCapacity = DEFAULT_STAGE_QUEUE_CAPACITY) {
+        auto pipeline = std::make_unique<Pipeline>(queueCapacity);
+        Channel<T>& channel = pipeline->template addChannel<T>();
+        pipeline->stages.push_back(std::make_unique<SourceStage<T, F>>(std::move(name), pipeline->control,
+            std::move(generate), channel));
+        StageBase* stage = pipeline->stages.back().get();
+        return PipelineBuilder(std::move(pipeline), &channel, stage);
+    }
+
+    template <typename F>
+    PipelineBuilder<std::decay_t<std::invoke_result_t<F&, T&&>>> stage(std::string name, std::size_t workers,
+        Ordering ordering, F transform) && {
+        using Out = std::decay_t<std::invoke_result_t<F&, T&&>>;
+        Channel<Out>& channel = pipeline->template addChannel<Out>();
+        pipeline->stages.push_back(std::make_unique<TransformStage<T, Out, F>>(std::move(name), workers, ordering,
+            pipeline->control, pipeline->queueCapacity, std::move(transform), *output, channel));
+        StageBase* stage = pipeline->stages.back().get();
+        producer->setDownstreamWorkers(stage->getWorkerCount());
+        return PipelineBuilder<Out>(std::move(pipeline), &channel, stage);
+    }
+
+    template <typename F>
+    std::unique_ptr<Pipeline> sink(std::string name, std::size_t workers, F consume) && {
+        pipeline->stages.push_back(std::make_unique<SinkStage<T, F>>(std::move(name), workers,
+            pipeline->control, std::move(consume), *output));
+        producer->setDownstreamWorkers(pipeline->stages.back()->getWorkerCount());
+        return std::move(pipeline);
+    }
+};
+
+#endif
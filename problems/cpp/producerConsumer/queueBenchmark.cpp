@@ -0,0 +1,295 @@
+// Throughput, latency and contention benchmark for the BoundedQueue variants.
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread queueBenchmark.cpp
+//
+// Every combination of the swept parameters is one run; SPSC only runs with one
+// producer and one consumer. Each element carries a 32-bit send timestamp, so
+// latencies are measured for every element size. Context switches come from
+// getrusage: voluntary switches are the threads that parked on a futex,
+// involuntary ones were preempted. Results are printed as a table and appended
+// as CSV to --output.
+#include "boundedQueue.hpp"
+#include <sys/resource.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchmarkConfig {
+    std::vector<std::string> kinds = {"mutex", "spsc", "mpmc"};
+    std::vector<std::size_t> producers = {1, 2, 4};
+    std::vector<std::size_t> consumers = {1, 2, 4};
+    std::vector<std::size_t> elementSizes = {4, 64, 1024};
+    std::vector<std::size_t> batches = {1, 32}; // 1 uses push/pop, larger values pushN/popN
+    std::size_t operations = 1000000; // elements per run
+    std::size_t capacity = 1024;
+    std::string output = "queue_bench.csv";
+    std::string label = "local";
+};
+
+struct RunParams {
+    QueueKind kind;
+    std::size_t producers;
+    std::size_t consumers;
+    std::size_t elementSize;
+    std::size_t batch;
+};
+
+struct RunResult {
+    std::size_t operations;
+    double seconds;
+    double opsPerSec;
+    double p50Micros;
+    double p99Micros;
+    double p999Micros;
+    long voluntarySwitches;
+    long involuntarySwitches;
+};
+
+template <std::size_t N>
+struct Payload {
+    static_assert(N >= sizeof(std::uint32_t), "payload must hold the send timestamp");
+    unsigned char bytes[N];
+};
+
+static std::int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::vector<std::size_t> parseList(const std::string& text) {
+    std::vector<std::size_t> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) values.push_back(std::stoull(item));
+    }
+    return values;
+}
+
+static std::vector<std::string> parseNames(const std::string& text) {
+    std::vector<std::string> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) values.push_back(item);
+    }
+    return values;
+}
+
+static bool parseKind(const std::string& name, QueueKind& kind) {
+    if (name == "mutex") kind = QueueKind::MUTEX;
+    else if (name == "spsc") kind = QueueKind::SPSC;
+    else if (name == "mpmc") kind = QueueKind::MPMC;
+    else return false;
+    return true;
+}
+
+static bool parseArgs(int argc, char** argv, BenchmarkConfig& config) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--kinds") config.kinds = parseNames(value);
+        else if (flag == "--producers") config.producers = parseList(value);
+        else if (flag == "--consumers") config.consumers = parseList(value);
+        else if (flag == "--sizes") config.elementSizes = parseList(value);
+        else if (flag == "--batch") config.batches = parseList(value);
+        else if (flag == "--operations") config.operations = std::stoull(value);
+        else if (flag == "--capacity") config.capacity = std::stoull(value);
+        else if (flag == "--output") config.output = value;
+        else if (flag == "--label") config.label = value;
+        else {
+            std::cerr << "Unknown flag " << flag << std::endl;
+            return false;
+        }
+    }
+    return (argc - 1) % 2 == 0;
+}
+
+static double percentile(const std::vector<std::int64_t>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    std::size_t index = std::min(sorted.size() - 1, (std::size_t)(fraction * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+// Low 32 bits of the time since the run started; differences stay exact below ~4s
+static std::uint32_t stamp(std::int64_t start) {
+    return (std::uint32_t)(nowNanos() - start);
+}
+
+template <typename Queue, std::size_t N>
+static RunResult runOnce(const RunParams& params, const BenchmarkConfig& config) {
+    Queue queue(config.capacity);
+    std::size_t operations = std::max(config.operations, params.producers * params.consumers);
+    std::size_t sampleEvery = std::max<std::size_t>(1, operations / 1000000);
+
+    std::vector<std::vector<std::int64_t>> latencies(params.consumers);
+    std::vector<std::thread> threads;
+    std::int64_t start = nowNanos();
+    rusage before;
+    getrusage(RUSAGE_SELF, &before);
+
+    // Quotas add up to the same total on both sides, so blocking pops always finish
+    for (std::size_t c = 0; c < params.consumers; c++) {
+        std::size_t quota = operations / params.consumers + (c < operations % params.consumers ? 1 : 0);
+        threads.emplace_back([&, c, quota] {
+            std::vector<Payload<N>> batch;
+            std::vector<std::int64_t>& local = latencies[c];
+            local.reserve(quota / sampleEvery + 1);
+            std::size_t seen = 0;
+            auto record = [&](const Payload<N>& payload) {
+                if (seen++ % sampleEvery != 0) return;
+                std::uint32_t sent;
+                std::memcpy(&sent, payload.bytes, sizeof(sent));
+                local.push_back((std::uint32_t)(stamp(start) - sent));
+            };
+            for (std::size_t done = 0; done < quota;) {
+                if (params.batch == 1) {
+                    record(queue.pop());
+                    done++;
+                    continue;
+                }
+                batch.clear();
+                done += queue.popN(batch, std::min(params.batch, quota - done));
+                for (const Payload<N>& payload : batch) {
+                    record(payload);
+                }
+            }
+        });
+    }
+    for (std::size_t p = 0; p < params.producers; p++) {
+        std::size_t quota = operations / params.producers + (p < operations % params.producers ? 1 : 0);
+        threads.emplace_back([&, quota] {
+            Payload<N> payload;
+            std::memset(payload.bytes, 'x', N);
+            std::vector<Payload<N>> batch;
+            for (std::size_t done = 0; done < quota;) {
+                if (params.batch == 1) {
+                    std::uint32_t sent = stamp(start);
+                    std::memcpy(payload.bytes, &sent, sizeof(sent));
+                    queue.push(payload);
+                    done++;
+                    continue;
+                }
+                batch.assign(std::min(params.batch, quota - done), payload);
+                std::uint32_t sent = stamp(start);
+                for (Payload<N>& element : batch) {
+                    std::memcpy(element.bytes, &sent, sizeof(sent));
+                }
+                queue.pushN(batch);
+                done += batch.size();
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = (nowNanos() - start) / 1e9;
+    rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    std::vector<std::int64_t> samples;
+    for (const auto& local : latencies) {
+        samples.insert(samples.end(), local.begin(), local.end());
+    }
+    std::sort(samples.begin(), samples.end());
+
+    RunResult result;
+    result.operations = operations;
+    result.seconds = seconds;
+    result.opsPerSec = operations / seconds;
+    result.p50Micros = percentile(samples, 0.50);
+    result.p99Micros = percentile(samples, 0.99);
+    result.p999Micros = percentile(samples, 0.999);
+    result.voluntarySwitches = after.ru_nvcsw - before.ru_nvcsw;
+    result.involuntarySwitches = after.ru_nivcsw - before.ru_nivcsw;
+    return result;
+}
+
+template <std::size_t N>
+static RunResult runKind(const RunParams& params, const BenchmarkConfig& config) {
+    switch (params.kind) {
+        case QueueKind::MUTEX: return runOnce<BoundedQueue<Payload<N>, QueueKind::MUTEX>, N>(params, config);
+        case QueueKind::SPSC: return runOnce<BoundedQueue<Payload<N>, QueueKind::SPSC>, N>(params, config);
+        default: return runOnce<BoundedQueue<Payload<N>, QueueKind::MPMC>, N>(params, config);
+    }
+}
+
+// Element sizes are template arguments, so only these are available
+static bool runSized(const RunParams& params, const BenchmarkConfig& config, RunResult& result) {
+    switch (params.elementSize) {
+        case 4: result = runKind<4>(params, config); return true;
+        case 16: result = runKind<16>(params, config); return true;
+        case 64: result = runKind<64>(params, config); return true;
+        case 256: result = runKind<256>(params, config); return true;
+        case 1024: result = runKind<1024>(params, config); return true;
+        default: return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchmarkConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        std::cerr << "Usage: queueBenchmark [--kinds mutex,spsc,mpmc] [--producers 1,2,4] [--consumers 1,2,4]\n"
+            << "    [--sizes 4,16,64,256,1024] [--batch 1,32] [--operations N] [--capacity N]\n"
+            << "    [--output file.csv] [--label name]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream existing(config.output);
+    bool writeHeader = !existing.good() || existing.peek() == std::ifstream::traits_type::eof();
+    existing.close();
+    std::ofstream csv(config.output, std::ios::app);
+    if (writeHeader) {
+        csv << "label,kind,producers,consumers,element_size,batch,capacity,operations,"
+            << "seconds,ops_per_sec,p50_us,p99_us,p999_us,voluntary_switches,involuntary_switches\n";
+    }
+
+    std::cout << std::left << std::setw(7) << "kind" << std::setw(5) << "pro" << std::setw(5) << "con"
+        << std::setw(6) << "size" << std::setw(7) << "batch" << std::setw(12) << "ops/s"
+        << std::setw(10) << "p50us" << std::setw(10) << "p99us" << std::setw(10) << "p999us"
+        << std::setw(10) << "vcsw" << "ivcsw" << std::endl;
+
+    for (const std::string& kindName : config.kinds)
+    for (std::size_t producers : config.producers)
+    for (std::size_t consumers : config.consumers)
+    for (std::size_t elementSize : config.elementSizes)
+    for (std::size_t batch : config.batches) {
+        QueueKind kind;
+        if (!parseKind(kindName, kind)) {
+            std::cerr << "Unknown queue kind " << kindName << std::endl;
+            return 1;
+        }
+        if (kind == QueueKind::SPSC && (producers != 1 || consumers != 1)) continue;
+        if (producers == 0 || consumers == 0) continue;
+
+        RunParams params{kind, producers, consumers, elementSize, std::max<std::size_t>(batch, 1)};
+        RunResult result;
+        if (!runSized(params, config, result)) {
+            std::cerr << "Unsupported element size " << elementSize << " (use 4, 16, 64, 256 or 1024)" << std::endl;
+            return 1;
+        }
+
+        std::cout << std::left << std::setw(7) << kindName << std::setw(5) << producers << std::setw(5) << consumers
+            << std::setw(6) << elementSize << std::setw(7) << params.batch
+            << std::setw(12) << (std::size_t)result.opsPerSec
+            << std::setw(10) << result.p50Micros << std::setw(10) << result.p99Micros
+            << std::setw(10) << result.p999Micros
+            << std::setw(10) << result.voluntarySwitches << result.involuntarySwitches << std::endl;
+
+        csv << config.label << "," << kindName << "," << producers << "," << consumers << "," << elementSize << ","
+            << params.batch << "," << config.capacity << "," << result.operations << "," << result.seconds << ","
+            << result.opsPerSec << "," << result.p50Micros << "," << result.p99Micros << ","
+            << result.p999Micros << "," << result.voluntarySwitches << "," << result.involuntarySwitches << "\n";
+        csv.flush();
+    }
+    return 0;
+}
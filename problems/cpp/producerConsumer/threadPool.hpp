@@ -0,0 +1,306 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include "boundedQueue.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+constexpr std::size_t DEFAULT_DEQUE_CAPACITY = 256;
+constexpr std::size_t DEFAULT_INJECTION_CAPACITY = 4096;
+
+// Chase-Lev work-stealing deque (Le et al. 2013 memory orderings). The owning
+// worker pushes and pops at the bottom; any other thread steals from the top.
+// Grown arrays are kept until destruction because a thief may still read them.
+template <typename T>
+class ChaseLevDeque {
+private:
+    struct Array {
+        std::size_t capacity;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Array(std::size_t capacity) : capacity(capacity), slots(new std::atomic<T>[capacity]) {}
+
+        T get(std::int64_t index) const { return slots[index & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(std::int64_t index, T value) { slots[index & (capacity - 1)].store(value, std::memory_order_relaxed); }
+    };
+
+    alignas(CACHE_LINE_SIZE) std::atomic<std::int64_t> top;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::int64_t> bottom;
+    std::atomic<Array*> array;
+    std::vector<std::unique_ptr<Array>> arrays; // owner only
+
+    Array* grow(Array* current, std::int64_t bottomIndex, std::int64_t topIndex) {
+        arrays.push_back(std::make_unique<Array>(current->capacity * 2));
+        Array* bigger = arrays.back().get();
+        for (std::int64_t i = topIndex; i < bottomIndex; i++) {
+            bigger->put(i, current->get(i));
+        }
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+public:
+    explicit ChaseLevDeque(std::size_t capacity = DEFAULT_DEQUE_CAPACITY) : top(0), bottom(0) {
+        arrays.push_back(std::make_unique<Array>(roundUpToPowerOfTwo(capacity > 1 ? capacity : 2)));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+    void push(T value) {
+        std::int64_t bottomIndex = bottom.load(std::memory_order_relaxed);
+        std::int64_t topIndex = top.load(std::memory_order_acquire);
+        Array* current = array.load(std::memory_order_relaxed);
+        if (bottomIndex - topIndex > (std::int64_t)current->capacity - 1) {
+            current = grow(current, bottomIndex, topIndex);
+        }
+        current->put(bottomIndex, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+    }
+
+    bool pop(T& value) {
+        std::int64_t bottomIndex = bottom.load(std::memory_order_relaxed) - 1;
+        Array* current = array.load(std::memory_order_relaxed);
+        bottom.store(bottomIndex, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t topIndex = top.load(std::memory_order_relaxed);
+
+        if (topIndex > bottomIndex) {
+            bottom.store(bottomIndex + 1, std::memory_order_relaxed); // already empty
+            return false;
+        }
+        value = current->get(bottomIndex);
+        if (topIndex == bottomIndex) {
+            // Last element: race the thieves for it
+            bool won = top.compare_exchange_strong(topIndex, topIndex + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(T& value) {
+        std::int64_t topIndex = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t bottomIndex = bottom.load(std::memory_order_acquire);
+        if (topIndex >= bottomIndex) return false;
+
+        Array* current = array.load(std::memory_order_acquire);
+        value = current->get(topIndex);
+        return top.compare_exchange_strong(topIndex, topIndex + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    std::size_t size() const {
+        std::int64_t bottomIndex = bottom.load(std::memory_order_relaxed);
+        std::int64_t topIndex = top.load(std::memory_order_relaxed);
+        return bottomIndex > topIndex ? bottomIndex - topIndex : 0;
+    }
+};
+
+class PoolTask {
+public:
+    virtual ~PoolTask() = default;
+    virtual void run() = 0;
+};
+
+template <typename F>
+class FunctionTask : public PoolTask {
+private:
+    F function;
+
+public:
+    explicit FunctionTask(F function) : function(std::move(function)) {}
+    void run() override { function(); }
+};
+
+// Work-stealing executor. Tasks submitted from a worker go to that worker's
+// deque, other submissions to a shared injection queue; idle workers steal
+// from random victims before parking.
+class ThreadPool {
+private:
+    struct alignas(CACHE_LINE_SIZE) Worker {
+        ChaseLevDeque<PoolTask*> deque;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    MpmcBoundedQueue<PoolTask*> injection;
+    AdaptiveWaiter idle;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> pendingTasks; // scheduled but not finished
+    std::atomic<bool> stopping;
+
+    struct WorkerContext {
+        ThreadPool* pool = nullptr;
+        std::size_t index = 0;
+        std::uint64_t seed = 0x9E3779B97F4A7C15ull;
+    };
+
+    static WorkerContext& context() {
+        static thread_local WorkerContext current;
+        return current;
+    }
+
+    std::size_t currentWorker() const {
+        const WorkerContext& current = context();
+        return current.pool == this ? current.index : SIZE_MAX;
+    }
+
+    void schedule(PoolTask* task) {
+        pendingTasks.fetch_add(1, std::memory_order_relaxed);
+        std::size_t index = currentWorker();
+        if (index != SIZE_MAX) {
+            workers[index]->deque.push(task);
+        }
+        else {
+            injection.push(task); // blocks while the injection queue is full
+        }
+        idle.notify(false);
+    }
+
+    // Own deque first (LIFO, cache-warm), then the injection queue, then a steal sweep
+    PoolTask* findTask(std::size_t index) {
+        PoolTask* task = nullptr;
+        if (index != SIZE_MAX && workers[index]->deque.pop(task)) return task;
+        if (injection.tryPop(task)) return task;
+
+        std::uint64_t& seed = context().seed;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        std::size_t start = seed % workers.size();
+        for (std::size_t i = 0; i < workers.size(); i++) {
+            std::size_t victim = (start + i) % workers.size();
+            if (victim != index && workers[victim]->deque.steal(task)) return task;
+        }
+        return nullptr;
+    }
+
+    void runTask(PoolTask* task) {
+        task->run();
+        delete task;
+        if (pendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1 && stopping.load(std::memory_order_acquire)) {
+            idle.notify(true); // let parked workers see that shutdown can finish
+        }
+    }
+
+    void workerLoop(std::size_t index) {
+        context().pool = this;
+        context().index = index;
+        context().seed += index * 0x2545F4914F6CDD1Dull;
+        while (true) {
+            PoolTask* task = nullptr;
+            idle.waitUntil([&] {
+                task = findTask(index);
+                return task || (stopping.load(std::memory_order_acquire)
+                    && pendingTasks.load(std::memory_order_acquire) == 0);
+            });
+            if (!task) return;
+            runTask(task);
+        }
+    }
+
+public:
+    explicit ThreadPool(std::size_t numThreads = std::thread::hardware_concurrency(),
+        std::size_t injectionCapacity = DEFAULT_INJECTION_CAPACITY)
+        : injection(injectionCapacity), pendingTasks(0), stopping(false) {
+        if (numThreads == 0) numThreads = 1;
+        for (std::size_t i = 0; i < numThreads; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (std::size_t i = 0; i < numThreads; i++) {
+            workers[i]->thread = std::thread([this, i] { workerLoop(i); });
+        }
+    }
+
+    // Finishes every submitted task, then joins
+    ~ThreadPool() {
+        stopping.store(true, std::memory_order_release);
+        idle.notify(true);
+        for (std::unique_ptr<Worker>& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // One pool per process, sized to the machine, for subsystems that do not own one
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    std::size_t getWorkerCount() const { return workers.size(); }
+
+    template <typename F>
+    std::future<std::invoke_result_t<std::decay_t<F>>> submit(F&& function) {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        std::packaged_task<Result()> task(std::forward<F>(function));
+        std::future<Result> future = task.get_future();
+        schedule(new FunctionTask<std::packaged_task<Result()>>(std::move(task)));
+        return future;
+    }
+
+    // Runs one pending task on the calling thread; false if none was found
+    bool runPendingTask() {
+        PoolTask* task = findTask(currentWorker());
+        if (!task) return false;
+        runTask(task);
+        return true;
+    }
+
+    // Calls body(i) for every i in [begin, end) in chunks of grain indexes.
+    // The caller runs tasks while it waits, so nesting inside a worker is safe.
+    // The first exception thrown by body is rethrown once every chunk is done.
+    template <typename Index, typename Body>
+    void parallelFor(Index begin, Index end, Body body, std::size_t grain = 0) {
+        if (!(begin < end)) return;
+
+        std::size_t total = (std::size_t)(end - begin);
+        if (grain == 0) grain = std::max<std::size_t>(1, total / (workers.size() * 4));
+        std::size_t chunks = (total + grain - 1) / grain;
+
+        std::atomic<std::size_t> remaining(chunks);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        for (std::size_t c = 0; c < chunks; c++) {
+            Index chunkBegin = begin + (Index)(c * grain);
+            Index chunkEnd = begin + (Index)std::min(total, (c + 1) * grain);
+            auto chunk = [&, chunkBegin, chunkEnd] {
+                try {
+                    for (Index i = chunkBegin; i < chunkEnd; i++) {
+                        body(i);
+                    }
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) error = std::current_exception();
+                }
+                remaining.fetch_sub(1, std::memory_order_release);
+            };
+            schedule(new FunctionTask<decltype(chunk)>(std::move(chunk)));
+        }
+
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!runPendingTask()) std::this_thread::yield();
+        }
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+#endif
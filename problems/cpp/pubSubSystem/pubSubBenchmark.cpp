@@ -0,0 +1,268 @@
+// Throughput and end-to-end latency benchmark for PubSubSystem.
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread -DPUBSUBSYSTEM_NO_MAIN pubSubBenchmark.cpp pubSubSystem.cpp topicLog.cpp
+//
+// Every combination of the swept parameters is one run. In "pattern" mode
+// subscribers listen on "bench/#", so each message reaches every subscriber
+// whatever its topic. In "exact" mode subscriber i subscribes to topic
+// i % topics by name, which measures direct delivery; a message then reaches
+// about fanout / topics subscribers. Results are printed as a table and
+// appended as CSV to --output.
+#include "pubSubSystem.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchmarkConfig {
+    std::vector<std::string> modes = {"pattern", "exact"};
+    std::vector<std::size_t> topics = {1, 64};
+    std::vector<std::size_t> fanouts = {1, 10, 100, 1000, 10000};
+    std::vector<std::size_t> payloads = {16, 1024};
+    std::vector<std::size_t> publishers = {1, 4};
+    std::vector<std::size_t> consumers = {1, 4};
+    std::vector<std::size_t> dispatchers = {0};
+    std::size_t deliveries = 2000000; // target deliveries per run
+    std::size_t mailboxCapacity = 256;
+    std::string output = "pubsub_bench.csv";
+    std::string label = "local";
+};
+
+struct RunParams {
+    bool exact; // subscribe to topics by name instead of through "bench/#"
+    std::size_t topics;
+    std::size_t fanout;
+    std::size_t payload;
+    std::size_t publishers;
+    std::size_t consumers;
+    std::size_t dispatchers;
+};
+
+struct RunResult {
+    std::size_t messages;
+    std::size_t deliveries;
+    double seconds;
+    double deliveriesPerSec;
+    double publishesPerSec;
+    double p50Micros;
+    double p99Micros;
+    double p999Micros;
+};
+
+static std::int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::vector<std::string> parseNames(const std::string& text) {
+    std::vector<std::string> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) values.push_back(item);
+    }
+    return values;
+}
+
+static std::vector<std::size_t> parseList(const std::string& text) {
+    std::vector<std::size_t> values;
+    for (const std::string& item : parseNames(text)) {
+        values.push_back(std::stoull(item));
+    }
+    return values;
+}
+
+static bool parseArgs(int argc, char** argv, BenchmarkConfig& config) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--modes") config.modes = parseNames(value);
+        else if (flag == "--topics") config.topics = parseList(value);
+        else if (flag == "--fanout") config.fanouts = parseList(value);
+        else if (flag == "--payload") config.payloads = parseList(value);
+        else if (flag == "--publishers") config.publishers = parseList(value);
+        else if (flag == "--consumers") config.consumers = parseList(value);
+        else if (flag == "--dispatchers") config.dispatchers = parseList(value);
+        else if (flag == "--deliveries") config.deliveries = std::stoull(value);
+        else if (flag == "--mailbox") config.mailboxCapacity = std::stoull(value);
+        else if (flag == "--output") config.output = value;
+        else if (flag == "--label") config.label = value;
+        else {
+            std::cerr << "Unknown flag " << flag << std::endl;
+            return false;
+        }
+    }
+    return (argc - 1) % 2 == 0;
+}
+
+static double percentile(const std::vector<std::int64_t>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    std::size_t index = std::min(sorted.size() - 1, (std::size_t)(fraction * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+static RunResult runOnce(const RunParams& params, const BenchmarkConfig& config) {
+    PubSubSystem pubSubSystem(params.dispatchers);
+    std::vector<std::string> topicNames;
+    for (std::size_t i = 0; i < params.topics; i++) {
+        topicNames.push_back("bench/" + std::to_string(i));
+        pubSubSystem.createTopic(topicNames.back(), "Benchmark topic");
+    }
+
+    // BLOCK keeps every delivery, so the run ends when all of them are drained
+    std::vector<Subcriber*> subcribers;
+    std::vector<std::size_t> topicFanout(params.topics, params.exact ? 0 : params.fanout);
+    for (std::size_t i = 0; i < params.fanout; i++) {
+        Subcriber* subcriber = pubSubSystem.addSubcriber("bench" + std::to_string(i),
+            config.mailboxCapacity, OverflowPolicy::BLOCK);
+        if (params.exact) {
+            pubSubSystem.subscribe(subcriber->getId(), topicNames[i % params.topics]);
+            topicFanout[i % params.topics]++;
+        }
+        else {
+            pubSubSystem.subscribe(subcriber->getId(), "bench/#");
+        }
+        subcribers.push_back(subcriber);
+    }
+
+    std::size_t averageFanout = std::max<std::size_t>(1, params.exact ? params.fanout / params.topics : params.fanout);
+    std::size_t messages = std::max<std::size_t>(params.publishers * 100, config.deliveries / averageFanout);
+    messages -= messages % params.publishers;
+    std::size_t expected = 0;
+    for (std::size_t i = 0; i < messages; i++) {
+        expected += topicFanout[i % params.topics]; // message i goes to topic i % topics
+    }
+    std::size_t sampleEvery = std::max<std::size_t>(1, expected / 1000000);
+
+    std::atomic<std::size_t> delivered(0);
+    std::vector<std::vector<std::int64_t>> latencies(params.consumers);
+    std::vector<std::thread> consumerThreads;
+    for (std::size_t c = 0; c < params.consumers; c++) {
+        consumerThreads.emplace_back([&, c] {
+            std::vector<MessagePtr> batch;
+            std::size_t seen = 0;
+            while (delivered.load(std::memory_order_relaxed) < expected) {
+                std::size_t drained = 0;
+                for (std::size_t i = c; i < subcribers.size(); i += params.consumers) {
+                    batch.clear();
+                    subcribers[i]->drainMessages(batch);
+                    std::int64_t now = nowNanos();
+                    for (const MessagePtr& message : batch) {
+                        if (seen++ % sampleEvery != 0) continue;
+                        std::int64_t sent;
+                        std::memcpy(&sent, message->getContent().data(), sizeof(sent));
+                        latencies[c].push_back(now - sent);
+                    }
+                    drained += batch.size();
+                }
+                if (drained == 0) {
+                    std::this_thread::yield();
+                }
+                else {
+                    delivered.fetch_add(drained, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+
+    std::int64_t start = nowNanos();
+    std::vector<std::thread> publisherThreads;
+    for (std::size_t p = 0; p < params.publishers; p++) {
+        publisherThreads.emplace_back([&, p] {
+            std::string payload(std::max<std::size_t>(params.payload, sizeof(std::int64_t)), 'x');
+            for (std::size_t i = p; i < messages; i += params.publishers) {
+                std::int64_t sent = nowNanos();
+                std::memcpy(payload.data(), &sent, sizeof(sent));
+                pubSubSystem.publish(topicNames[i % topicNames.size()], payload);
+            }
+        });
+    }
+    for (std::thread& thread : publisherThreads) {
+        thread.join();
+    }
+    double publishSeconds = (nowNanos() - start) / 1e9;
+    for (std::thread& thread : consumerThreads) {
+        thread.join();
+    }
+    double seconds = (nowNanos() - start) / 1e9;
+
+    std::vector<std::int64_t> samples;
+    for (const auto& local : latencies) {
+        samples.insert(samples.end(), local.begin(), local.end());
+    }
+    std::sort(samples.begin(), samples.end());
+
+    RunResult result;
+    result.messages = messages;
+    result.deliveries = expected;
+    result.seconds = seconds;
+    result.deliveriesPerSec = expected / seconds;
+    result.publishesPerSec = messages / publishSeconds;
+    result.p50Micros = percentile(samples, 0.50);
+    result.p99Micros = percentile(samples, 0.99);
+    result.p999Micros = percentile(samples, 0.999);
+    return result;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        std::cerr << "Usage: pubSubBenchmark [--modes pattern,exact] [--topics 1,64] [--fanout 1,10,100]\n"
+            << "    [--payload 16,1024] [--publishers 1,4] [--consumers 1,4] [--dispatchers 0,2]\n"
+            << "    [--deliveries N] [--mailbox N] [--output file.csv] [--label name]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream existing(config.output);
+    bool writeHeader = !existing.good() || existing.peek() == std::ifstream::traits_type::eof();
+    existing.close();
+    std::ofstream csv(config.output, std::ios::app);
+    if (writeHeader) {
+        csv << "label,mode,topics,fanout,payload,publishers,consumers,dispatchers,messages,deliveries,"
+            << "seconds,deliveries_per_sec,publishes_per_sec,p50_us,p99_us,p999_us\n";
+    }
+
+    std::cout << std::left << std::setw(9) << "mode" << std::setw(8) << "topics" << std::setw(8) << "fanout"
+        << std::setw(9) << "payload"
+        << std::setw(5) << "pub" << std::setw(5) << "con" << std::setw(6) << "disp"
+        << std::setw(14) << "deliv/s" << std::setw(12) << "pub/s"
+        << std::setw(10) << "p50us" << std::setw(10) << "p99us" << "p999us" << std::endl;
+
+    for (const std::string& mode : config.modes)
+    for (std::size_t topics : config.topics)
+    for (std::size_t fanout : config.fanouts)
+    for (std::size_t payload : config.payloads)
+    for (std::size_t publishers : config.publishers)
+    for (std::size_t consumers : config.consumers)
+    for (std::size_t dispatchers : config.dispatchers) {
+        if (mode != "pattern" && mode != "exact") {
+            std::cerr << "Unknown subscription mode " << mode << std::endl;
+            return 1;
+        }
+        if (topics == 0 || fanout == 0 || publishers == 0 || consumers == 0) continue;
+
+        RunParams params{mode == "exact", topics, fanout, payload, publishers, consumers, dispatchers};
+        RunResult result = runOnce(params, config);
+
+        std::cout << std::left << std::setw(9) << mode << std::setw(8) << topics << std::setw(8) << fanout << std::setw(9) << payload
+            << std::setw(5) << publishers << std::setw(5) << consumers << std::setw(6) << dispatchers
+            << std::setw(14) << (std::size_t)result.deliveriesPerSec
+            << std::setw(12) << (std::size_t)result.publishesPerSec
+            << std::setw(10) << result.p50Micros << std::setw(10) << result.p99Micros
+            << result.p999Micros << std::endl;
+
+        csv << config.label << "," << mode << "," << topics << "," << fanout << "," << payload << "," << publishers << ","
+            << consumers << "," << dispatchers << "," << result.messages << "," << result.deliveries << ","
+            << result.seconds << "," << result.deliveriesPerSec << "," << result.publishesPerSec << ","
+            << result.p50Micros << "," << result.p99Micros << "," << result.p999Micros << "\n";
+        csv.flush();
+    }
+    return 0;
+}
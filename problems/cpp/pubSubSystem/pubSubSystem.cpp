@@ -1,103 +1,1488 @@
 #include "pubSubSystem.hpp"
+#include "topicLog.hpp"
 #include <iostream>
 #include <thread>
+#include <utility>
+#include <new>
+#include <algorithm>
+
+std::int64_t steadyNowMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 Message::Message(std::string topic, std::string content)
-    : topic(topic), content(content) {
+    : Message(std::move(topic), std::move(content), nullptr) {}
+
+Message::Message(std::string topic, std::string content, Headers headers)
+    : Message(std::move(topic), std::move(content), nullptr) {
+    this->headers = std::move(headers);
+}
+
+Message::Message(std::string topic, std::string content, Block* block)
+    : topic(std::move(topic)), content(std::move(content)), offset(NO_OFFSET), expiresAt(0),
+      partition(0), refCount(1), block(block) {
         timestamp = std::time(nullptr);
 }
 
-std::string Message::getTopic() const { return topic; }
-std::string Message::getContent() const { return content; }
+Message::Message(std::string topic, std::string content, std::time_t timestamp, std::uint64_t offset)
+    : topic(std::move(topic)), content(std::move(content)), timestamp(timestamp),
+      offset(offset), expiresAt(0), partition(0), refCount(1), block(nullptr) {}
+
+template <typename Content>
+Message* Message::createBlock(const std::string& topic, std::span<const Content> contents) {
+    if (contents.empty()) return nullptr;
+
+    constexpr std::size_t headerSize =
+        (sizeof(Block) + alignof(Message) - 1) / alignof(Message) * alignof(Message);
+    char* storage = static_cast<char*>(::operator new(headerSize + sizeof(Message) * contents.size()));
+
+    Block* block = new (storage) Block{contents.size()};
+    Message* messages = reinterpret_cast<Message*>(storage + headerSize);
+    for (std::size_t i = 0; i < contents.size(); i++) {
+        new (&messages[i]) Message(topic, std::string(contents[i]), block);
+    }
+    return messages;
+}
+
+Message* Message::createBatch(const std::string& topic, std::span<const std::string> contents) {
+    return createBlock(topic, contents);
+}
+
+Message* Message::createBatch(const std::string& topic, std::span<const std::string_view> contents) {
+    return createBlock(topic, contents);
+}
+
+std::string_view Message::getTopic() const { return topic; }
+std::string_view Message::getContent() const { return content; }
+const Headers& Message::getHeaders() const { return headers; }
+
+std::optional<std::string_view> Message::getHeader(std::string_view name) const {
+    for (const auto& [headerName, headerValue] : headers) {
+        if (headerName == name) return std::string_view(headerValue);
+    }
+    return std::nullopt;
+}
+std::time_t Message::getTimestamp() const { return timestamp; }
+std::uint64_t Message::getOffset() const { return offset; }
+std::uint32_t Message::getPartition() const { return partition; }
+std::int64_t Message::getExpiresAt() const { return expiresAt; }
+
+bool Message::isExpired(std::int64_t nowMillis) const {
+    return expiresAt != 0 && expiresAt <= nowMillis;
+}
+
+void Message::retain() const {
+    refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Message::release() const {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    if (!block) {
+        delete this;
+        return;
+    }
+    Block* owner = block;
+    this->~Message();
+    if (owner->liveCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        owner->~Block();
+        ::operator delete(owner);
+    }
+}
+
+MessagePtr::MessagePtr() : message(nullptr) {}
+MessagePtr::MessagePtr(const Message* message) : message(message) {}
+
+MessagePtr::MessagePtr(const MessagePtr& other) : message(other.message) {
+    if (message) message->retain();
+}
+
+MessagePtr::MessagePtr(MessagePtr&& other) noexcept : message(other.message) {
+    other.message = nullptr;
+}
+
+MessagePtr& MessagePtr::operator=(MessagePtr other) noexcept {
+    std::swap(message, other.message);
+    return *this;
+}
+
+MessagePtr::~MessagePtr() {
+    if (message) message->release();
+}
+
+const Message* MessagePtr::get() const { return message; }
+const Message* MessagePtr::operator->() const { return message; }
+const Message& MessagePtr::operator*() const { return *message; }
+MessagePtr::operator bool() const { return message != nullptr; }
+
+Mailbox::Mailbox(std::size_t capacity, OverflowPolicy policy)
+    : policy(policy), enqueuePos(0), dequeuePos(0), droppedCount(0), expiredCount(0), purgedCells(0) {
+    std::size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    buffer = new Cell[size];
+    mask = size - 1;
+    for (std::size_t i = 0; i < size; i++) {
+        buffer[i].sequence.store(i, std::memory_order_relaxed);
+        buffer[i].deadline.store(0, std::memory_order_relaxed);
+        buffer[i].message.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+Mailbox::~Mailbox() {
+    Message* message;
+    while (tryPop(message)) {
+        message->release();
+    }
+    delete[] buffer;
+}
+
+std::size_t Mailbox::getCapacity() const { return mask + 1; }
+std::size_t Mailbox::getDroppedCount() const { return droppedCount.load(std::memory_order_relaxed); }
+std::size_t Mailbox::getExpiredCount() const { return expiredCount.load(std::memory_order_relaxed); }
+OverflowPolicy Mailbox::getPolicy() const { return policy; }
+
+std::size_t Mailbox::getSize() const {
+    std::size_t tail = enqueuePos.load(std::memory_order_acquire);
+    std::size_t head = dequeuePos.load(std::memory_order_acquire);
+    // The counters are read apart and may lag each other; wrapping math clamps to 0
+    std::intptr_t live = (std::intptr_t)(tail - head - purgedCells.load(std::memory_order_relaxed));
+    return live > 0 ? (std::size_t)live : 0;
+}
+
+bool Mailbox::isEmpty() const {
+    return enqueuePos.load(std::memory_order_acquire) == dequeuePos.load(std::memory_order_acquire);
+}
+
+bool Mailbox::tryPush(Message* message, std::size_t& pos) {
+    Cell* cell;
+    pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        cell = &buffer[pos & mask];
+        std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+            return false; // full, including a cell held by purgeExpired
+        }
+        else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->message.store(message, std::memory_order_relaxed);
+    cell->deadline.store(message->getExpiresAt(), std::memory_order_relaxed);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+// Claims as many consecutive free cells as possible with a single CAS
+std::size_t Mailbox::tryPushBatch(Message* const* messages, std::size_t count, std::size_t& first) {
+    std::size_t n;
+    std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        n = 0;
+        while (n < count && buffer[(pos + n) & mask].sequence.load(std::memory_order_acquire) == pos + n) {
+            n++;
+        }
+        if (n == 0) {
+            std::size_t seq = buffer[pos & mask].sequence.load(std::memory_order_acquire);
+            if ((std::intptr_t)seq - (std::intptr_t)pos < 0) return 0; // full
+            pos = enqueuePos.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (enqueuePos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+    }
+    for (std::size_t i = 0; i < n; i++) {
+        Cell* cell = &buffer[(pos + i) & mask];
+        cell->message.store(messages[i], std::memory_order_relaxed);
+        cell->deadline.store(messages[i]->getExpiresAt(), std::memory_order_relaxed);
+        cell->sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    first = pos;
+    return n;
+}
+
+bool Mailbox::popCell(Message*& message) {
+    Cell* cell;
+    std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+        cell = &buffer[pos & mask];
+        std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if (seq == PURGING) {
+            std::this_thread::yield(); // occupied; purgeExpired hands it back in a moment
+            continue;
+        }
+        std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+            return false; // empty
+        }
+        else {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+    message = cell->message.exchange(nullptr, std::memory_order_relaxed);
+    releaseCell(cell, pos);
+    if (!message) purgedCells.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+// A purge holding the cell puts pos + 1 back when it is done, so wait for that
+void Mailbox::releaseCell(Cell* cell, std::size_t pos) {
+    std::size_t expected = pos + 1;
+    while (!cell->sequence.compare_exchange_weak(expected, pos + mask + 1,
+        std::memory_order_release, std::memory_order_relaxed)) {
+        if (expected == PURGING) std::this_thread::yield();
+        expected = pos + 1;
+    }
+}
+
+bool Mailbox::tryPop(Message*& message) {
+    while (popCell(message)) {
+        if (message) return true; // cells purged in place are skipped
+    }
+    return false;
+}
+
+bool Mailbox::push(Message* message, std::size_t* position) {
+    std::size_t pos;
+    if (policy == OverflowPolicy::DROP_NEWEST) {
+        if (!tryPush(message, pos)) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            message->release();
+            return false;
+        }
+        if (position) *position = pos;
+        return true;
+    }
+
+    while (!tryPush(message, pos)) {
+        if (policy == OverflowPolicy::DROP_OLDEST) {
+            Message* oldest;
+            if (popCell(oldest) && oldest) {
+                droppedCount.fetch_add(1, std::memory_order_relaxed);
+                oldest->release();
+            }
+        }
+        else {
+            std::this_thread::yield(); // BLOCK: wait for the consumer to make room
+        }
+    }
+    if (position) *position = pos;
+    return true;
+}
+
+std::size_t Mailbox::pushBatch(Message* const* messages, std::size_t count, std::size_t* positions) {
+    std::size_t pushed = 0;
+    auto pushSome = [&] {
+        std::size_t first;
+        std::size_t n = tryPushBatch(messages + pushed, count - pushed, first);
+        for (std::size_t i = 0; positions && i < n; i++) {
+            positions[pushed + i] = first + i;
+        }
+        pushed += n;
+    };
+    pushSome();
+    while (pushed < count) {
+        if (policy == OverflowPolicy::DROP_NEWEST) {
+            droppedCount.fetch_add(count - pushed, std::memory_order_relaxed);
+            for (std::size_t i = pushed; i < count; i++) {
+                messages[i]->release();
+            }
+            return pushed;
+        }
+        if (policy == OverflowPolicy::DROP_OLDEST) {
+            Message* oldest;
+            if (popCell(oldest) && oldest) {
+                droppedCount.fetch_add(1, std::memory_order_relaxed);
+                oldest->release();
+            }
+        }
+        else {
+            std::this_thread::yield();
+        }
+        pushSome();
+    }
+    return pushed;
+}
+
+std::size_t Mailbox::drain(std::vector<Message*>& out, std::size_t maxMessages) {
+    std::size_t count = 0;
+    Message* message;
+    while (count < maxMessages && tryPop(message)) {
+        out.push_back(message);
+        count++;
+    }
+    return count;
+}
+
+// The cell is held by swapping its sequence to PURGING, so neither a consumer nor
+// the next lap's producer can touch it meanwhile. Its sequence is position + 1
+// only while the message pushed at position is still queued there.
+bool Mailbox::purgeCell(std::size_t position, std::int64_t nowMillis, std::int64_t& laterDeadline) {
+    laterDeadline = 0;
+    Cell* cell = &buffer[position & mask];
+    std::size_t expected = position + 1;
+    if (!cell->sequence.compare_exchange_strong(expected, PURGING, std::memory_order_acquire)) return false;
+
+    Message* message = nullptr;
+    std::int64_t deadline = cell->deadline.load(std::memory_order_relaxed);
+    if (deadline > nowMillis) {
+        laterDeadline = deadline;
+    }
+    else {
+        message = cell->message.exchange(nullptr, std::memory_order_relaxed);
+    }
+    if (message) purgedCells.fetch_add(1, std::memory_order_relaxed);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    if (!message) return false; // a consumer that already claimed the cell got it first
+
+    message->release();
+    countExpired(1);
+    skipPurgedHead();
+    return true;
+}
+
+// Consumers skip purged cells anyway; popping them here gives producers the room
+// back while nobody consumes. Each cell is skipped once.
+void Mailbox::skipPurgedHead() {
+    std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Cell* cell = &buffer[pos & mask];
+        if (cell->sequence.load(std::memory_order_acquire) != pos + 1) return;
+        if (cell->message.load(std::memory_order_relaxed)) return;
+        if (!dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) continue;
+        releaseCell(cell, pos);
+        purgedCells.fetch_sub(1, std::memory_order_relaxed);
+        pos++;
+    }
+}
+
+void Mailbox::countExpired(std::size_t count) {
+    if (count > 0) expiredCount.fetch_add(count, std::memory_order_relaxed);
+}
+
+TimingWheel::TimingWheel(std::int64_t tickMillis, std::int64_t startMillis)
+    : tickMillis(tickMillis > 0 ? tickMillis : 1), currentTick(startMillis / this->tickMillis), entryCount(0) {}
+
+void TimingWheel::insertLocked(Entry entry) {
+    const std::int64_t span = (std::int64_t)1 << (SLOT_BITS * LEVELS);
+    if (entry.deadlineTick - currentTick >= span) entry.deadlineTick = currentTick + span - 1;
+
+    std::int64_t delta = entry.deadlineTick - currentTick;
+    std::size_t level = 0;
+    while (level + 1 < LEVELS && delta >= ((std::int64_t)1 << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    std::size_t slot = (entry.deadlineTick >> (SLOT_BITS * level)) & (SLOTS - 1);
+    slots[level][slot].push_back(entry);
+}
+
+void TimingWheel::schedule(std::span<const Expiry> expiries) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const Expiry& expiry : expiries) {
+        std::int64_t deadlineTick = (expiry.deadlineMillis + tickMillis - 1) / tickMillis;
+        insertLocked(Entry{std::max(deadlineTick, currentTick + 1), expiry.subcriber, expiry.position});
+    }
+    entryCount += expiries.size();
+}
+
+void TimingWheel::cancel(Subcriber* subcriber) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (std::size_t level = 0; level < LEVELS; level++) {
+        for (std::size_t slot = 0; slot < SLOTS; slot++) {
+            std::vector<Entry>& entries = slots[level][slot];
+            std::size_t before = entries.size();
+            entries.erase(std::remove_if(entries.begin(), entries.end(),
+                [subcriber](const Entry& entry) { return entry.subcriber == subcriber; }), entries.end());
+            entryCount -= before - entries.size();
+        }
+    }
+}
+
+std::size_t TimingWheel::advance(std::int64_t nowMillis, std::vector<std::pair<Subcriber*, std::size_t>>& due) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::int64_t nowTick = nowMillis / tickMillis;
+    std::size_t fired = 0;
+    while (currentTick < nowTick) {
+        if (entryCount == 0) {
+            currentTick = nowTick;
+            break;
+        }
+        currentTick++;
+
+        // Entering a new lap of a level pulls the matching higher-level slot down
+        for (std::size_t level = 1; level < LEVELS; level++) {
+            if ((currentTick & (((std::int64_t)1 << (SLOT_BITS * level)) - 1)) != 0) break;
+
+            std::size_t slot = (currentTick >> (SLOT_BITS * level)) & (SLOTS - 1);
+            std::vector<Entry> cascading;
+            cascading.swap(slots[level][slot]);
+            for (const Entry& entry : cascading) {
+                insertLocked(entry);
+            }
+        }
+
+        std::vector<Entry>& expiring = slots[0][currentTick & (SLOTS - 1)];
+        for (const Entry& entry : expiring) {
+            due.emplace_back(entry.subcriber, entry.position);
+        }
+        fired += expiring.size();
+        entryCount -= expiring.size();
+        expiring.clear();
+    }
+    return fired;
+}
+
+ConsumerTask::ConsumerTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+ConsumerTask::ConsumerTask(ConsumerTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+ConsumerTask::~ConsumerTask() {
+    if (handle) handle.destroy();
+}
+
+std::coroutine_handle<ConsumerTask::promise_type> ConsumerTask::release() {
+    return std::exchange(handle, nullptr);
+}
+
+CoroutineExecutor::CoroutineExecutor(std::size_t numThreads) : stopping(false) {
+    if (numThreads == 0) numThreads = 1;
+    for (std::size_t i = 0; i < numThreads; i++) {
+        workers.emplace_back([this] { run(); });
+    }
+}
+
+CoroutineExecutor::~CoroutineExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    readyCond.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void CoroutineExecutor::run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        readyCond.wait(lock, [this] { return stopping || !ready.empty(); });
+        if (ready.empty()) return;
+
+        std::coroutine_handle<> handle = ready.front();
+        ready.pop_front();
+        lock.unlock();
+        handle.resume(); // runs until the coroutine's next co_await or its end
+        lock.lock();
+    }
+}
+
+void CoroutineExecutor::post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ready.push_back(handle);
+    }
+    readyCond.notify_one();
+}
+
+void CoroutineExecutor::spawn(ConsumerTask task) {
+    std::coroutine_handle<ConsumerTask::promise_type> handle = task.release();
+    handle.promise().executor = this;
+    post(handle);
+}
+
+Subcriber::Subcriber(std::string subcriberId, std::string name,
+    std::size_t mailboxCapacity, OverflowPolicy policy, SubscriberId handle)
+    : subcriberId(subcriberId), handle(handle), name(name), mailbox(mailboxCapacity, policy), active(true),
+      expiryWheel(nullptr), waiter(nullptr), closed(false) {}
+
+const std::string& Subcriber::getId() const { return subcriberId; }
+SubscriberId Subcriber::getHandle() const { return handle; }
+std::string Subcriber::getName() const { return name; }
+bool Subcriber::isActive() const { return active.load(std::memory_order_relaxed); }
+std::size_t Subcriber::getPendingCount() const { return mailbox.getSize(); }
+std::size_t Subcriber::getDroppedCount() const { return mailbox.getDroppedCount(); }
+std::size_t Subcriber::getExpiredCount() const { return mailbox.getExpiredCount(); }
+
+bool Subcriber::receiveMessage(Message* message) {
+    if (!isActive()) return false;
+
+    message->retain();
+    std::size_t position;
+    if (!mailbox.push(message, &position)) return false;
+    scheduleExpiry(&message, &position, 1); // the publisher's reference keeps message alive
+    wake();
+    return true;
+}
+
+std::size_t Subcriber::receiveBatch(Message* const* messages, std::size_t count) {
+    if (!isActive() || count == 0) return 0;
+
+    bool expiring = false;
+    for (std::size_t i = 0; i < count; i++) {
+        messages[i]->retain();
+        expiring = expiring || messages[i]->getExpiresAt() != 0;
+    }
+    if (!expiring || !expiryWheel) {
+        std::size_t received = mailbox.pushBatch(messages, count);
+        if (received > 0) wake();
+        return received;
+    }
+
+    std::vector<std::size_t> positions(count);
+    std::size_t received = mailbox.pushBatch(messages, count, positions.data());
+    scheduleExpiry(messages, positions.data(), received);
+    if (received > 0) wake();
+    return received;
+}
+
+std::size_t Subcriber::drainMessages(std::vector<MessagePtr>& out, std::size_t maxMessages) {
+    std::size_t count = 0;
+    std::size_t expired = 0;
+    std::int64_t now = steadyNowMillis();
+    Message* message;
+    while (count < maxMessages && mailbox.tryPop(message)) {
+        if (message->isExpired(now)) {
+            message->release(); // stale messages behind the head are skipped here
+            expired++;
+            continue;
+        }
+        out.emplace_back(message);
+        count++;
+    }
+    mailbox.countExpired(expired);
+    return count;
+}
+
+void Subcriber::clearMessage() {
+    Message* message;
+    while (mailbox.tryPop(message)) {
+        message->release();
+    }
+}
+
+// Only the groups this subscriber belongs to reassign partitions
+void Subcriber::setActive(bool status) {
+    std::lock_guard<std::mutex> lock(groupMutex);
+    if (active.exchange(status, std::memory_order_relaxed) == status) return;
+
+    for (ConsumerGroup* group : groups) {
+        group->rebalance();
+    }
+}
+
+void Subcriber::setExpiryWheel(TimingWheel* wheel) {
+    expiryWheel = wheel;
+}
+
+// One wheel entry per message with a deadline, stamped with its mailbox position
+void Subcriber::scheduleExpiry(Message* const* messages, const std::size_t* positions, std::size_t count) {
+    if (!expiryWheel) return;
+
+    std::vector<TimingWheel::Expiry> expiries;
+    for (std::size_t i = 0; i < count; i++) {
+        std::int64_t deadline = messages[i]->getExpiresAt();
+        if (deadline != 0) expiries.push_back(TimingWheel::Expiry{this, positions[i], deadline});
+    }
+    if (!expiries.empty()) expiryWheel->schedule(expiries);
+}
+
+bool Subcriber::expireMessage(std::size_t position, std::int64_t nowMillis) {
+    std::int64_t laterDeadline;
+    if (mailbox.purgeCell(position, nowMillis, laterDeadline)) return true;
+    if (laterDeadline != 0 && expiryWheel) {
+        // Deadlines past the wheel's span fire early and go around again
+        TimingWheel::Expiry expiry{this, position, laterDeadline};
+        expiryWheel->schedule(std::span<const TimingWheel::Expiry>(&expiry, 1));
+    }
+    return false;
+}
+
+bool Subcriber::popLive(Message*& message) {
+    std::int64_t now = steadyNowMillis();
+    while (mailbox.tryPop(message)) {
+        if (!message->isExpired(now)) return true;
+        message->release();
+        mailbox.countExpired(1);
+    }
+    return false;
+}
+
+// The fences pair with wake(): either the delivery sees the parked waiter,
+// or the recheck here sees the delivered message
+bool Subcriber::park(Waiter* parked) {
+    while (true) {
+        if (popLive(parked->message) || closed.load(std::memory_order_acquire)) return false;
+
+        waiter.store(parked, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mailbox.isEmpty() && !closed.load(std::memory_order_acquire)) return true;
+        if (waiter.exchange(nullptr, std::memory_order_acq_rel) != parked) {
+            return true; // a delivery already claimed the waiter and will resume it
+        }
+    }
+}
+
+// Pops the message on the delivering thread, so the executor only has to resume
+void Subcriber::wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiter.load(std::memory_order_relaxed)) return;
+
+    Waiter* parked = waiter.exchange(nullptr, std::memory_order_acq_rel);
+    if (parked && !park(parked)) {
+        parked->executor->post(parked->handle);
+    }
+}
+
+void Subcriber::close() {
+    closed.store(true, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Waiter* parked = waiter.exchange(nullptr, std::memory_order_acq_rel);
+    if (parked) {
+        parked->executor->post(parked->handle); // resumes with an empty message
+    }
+}
+
+Subcriber::MessageAwaiter Subcriber::next() {
+    return MessageAwaiter(this);
+}
+
+Subcriber::MessageAwaiter::MessageAwaiter(Subcriber* subcriber) : subcriber(subcriber) {}
+
+bool Subcriber::MessageAwaiter::await_ready() {
+    return subcriber->popLive(waiter.message) || subcriber->closed.load(std::memory_order_acquire);
+}
+
+bool Subcriber::MessageAwaiter::await_suspend(std::coroutine_handle<ConsumerTask::promise_type> handle) {
+    waiter.handle = handle;
+    waiter.executor = handle.promise().executor;
+    return subcriber->park(&waiter);
+}
+
+MessagePtr Subcriber::MessageAwaiter::await_resume() {
+    return MessagePtr(std::exchange(waiter.message, nullptr));
+}
+
+ContentFilter::ContentFilter(FilterSpec spec)
+    : spec(std::move(spec)),
+      searcher(this->spec.pattern.data(), this->spec.pattern.data() + this->spec.pattern.size()) {}
+
+const FilterSpec& ContentFilter::getSpec() const { return spec; }
+
+bool ContentFilter::matches(const Message& message) const {
+    std::string_view content = message.getContent();
+    switch (spec.type) {
+        case FilterType::PREFIX:
+            return content.substr(0, spec.pattern.size()) == spec.pattern;
+        case FilterType::SUBSTRING: {
+            const char* end = content.data() + content.size();
+            return spec.pattern.empty() || searcher(content.data(), end).first != end;
+        }
+        case FilterType::HEADER_EQUALS: {
+            std::optional<std::string_view> value = message.getHeader(spec.pattern);
+            return value && *value == spec.value;
+        }
+    }
+    return false;
+}
+
+std::string ContentFilter::canonicalKey(const FilterSpec& spec) {
+    return std::to_string((int)spec.type) + ":" + std::to_string(spec.pattern.size()) + ":" +
+        spec.pattern + ":" + spec.value;
+}
+
+ConsumerGroup::ConsumerGroup(std::string name, std::size_t partitionCount)
+    : name(name), partitionCount(partitionCount),
+      owners(new std::vector<Subcriber*>(partitionCount, nullptr)) {}
+
+ConsumerGroup::~ConsumerGroup() {
+    for (Subcriber* member : members) {
+        std::lock_guard<std::mutex> memberLock(member->groupMutex);
+        std::erase(member->groups, this);
+    }
+    EpochDomain::global().retire(owners.load());
+}
+
+std::string ConsumerGroup::getName() const { return name; }
+
+std::vector<Subcriber*> ConsumerGroup::getMembers() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return members;
+}
+
+std::vector<std::size_t> ConsumerGroup::getAssignment(Subcriber* subcriber) {
+    EpochGuard guard;
+    const std::vector<Subcriber*>& table = *owners.load(std::memory_order_acquire);
+    std::vector<std::size_t> partitions;
+    for (std::size_t partition = 0; partition < partitionCount; partition++) {
+        if (table[partition] == subcriber) partitions.push_back(partition);
+    }
+    return partitions;
+}
+
+// Spreads partitions round robin over the active members, in join order
+void ConsumerGroup::rebalanceLocked() {
+    std::vector<Subcriber*> activeMembers;
+    for (Subcriber* member : members) {
+        if (member->isActive()) activeMembers.push_back(member);
+    }
+    auto next = new std::vector<Subcriber*>(partitionCount, nullptr);
+    for (std::size_t partition = 0; partition < partitionCount && !activeMembers.empty(); partition++) {
+        (*next)[partition] = activeMembers[partition % activeMembers.size()];
+    }
+    EpochDomain::global().retire(owners.exchange(next, std::memory_order_acq_rel));
+}
+
+void ConsumerGroup::rebalance() {
+    std::lock_guard<std::mutex> lock(mtx);
+    rebalanceLocked();
+}
+
+bool ConsumerGroup::addMember(Subcriber* subcriber) {
+    if (!subcriber) return false;
+
+    std::lock_guard<std::mutex> memberLock(subcriber->groupMutex);
+    std::lock_guard<std::mutex> lock(mtx);
+    if (std::find(members.begin(), members.end(), subcriber) != members.end()) return false;
+
+    members.push_back(subcriber);
+    subcriber->groups.push_back(this);
+    rebalanceLocked();
+    return true;
+}
+
+bool ConsumerGroup::removeMember(Subcriber* subcriber) {
+    if (!subcriber) return false;
+
+    std::lock_guard<std::mutex> memberLock(subcriber->groupMutex);
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::find(members.begin(), members.end(), subcriber);
+    if (it == members.end()) return false;
+
+    members.erase(it);
+    std::erase(subcriber->groups, this);
+    rebalanceLocked();
+    return true;
+}
+
+Subcriber* ConsumerGroup::getOwner(std::size_t partition) const {
+    return (*owners.load(std::memory_order_acquire))[partition % partitionCount];
+}
+
+thread_local EpochDomain::ThreadState EpochDomain::threadState;
+
+EpochDomain::EpochDomain() : globalEpoch(1) {}
+
+EpochDomain::~EpochDomain() {
+    for (const Retired& entry : retired) {
+        entry.destroy(entry.pointer);
+    }
+    SlotBlock* block = firstBlock.next.load();
+    while (block) {
+        delete std::exchange(block, block->next.load());
+    }
+}
+
+EpochDomain::ThreadState::~ThreadState() {
+    if (slot) slot->claimed.store(false, std::memory_order_release);
+}
+
+EpochDomain& EpochDomain::global() {
+    static EpochDomain domain;
+    return domain;
+}
+
+// Called once per thread. The next pointers are seq_cst so a scan that misses a new
+// block is ordered before every pin made in it.
+EpochDomain::ReaderSlot* EpochDomain::claimSlot() {
+    SlotBlock* block = &firstBlock;
+    while (true) {
+        for (ReaderSlot& slot : block->slots) {
+            bool expected = false;
+            if (!slot.claimed.load(std::memory_order_relaxed)
+                && slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return &slot;
+            }
+        }
+
+        SlotBlock* next = block->next.load();
+        if (!next) {
+            auto grown = std::make_unique<SlotBlock>();
+            grown->slots[0].claimed.store(true, std::memory_order_relaxed);
+            if (block->next.compare_exchange_strong(next, grown.get())) {
+                return &grown.release()->slots[0];
+            }
+        }
+        block = next; // the block we found, or the one another thread appended first
+    }
+}
+
+void EpochDomain::enter() {
+    ThreadState& state = threadState;
+    if (state.depth++ > 0) return;
+
+    if (!state.slot) state.slot = claimSlot();
+    // seq_cst orders the pin before every snapshot load in the read section
+    state.slot->epoch.store(globalEpoch.load());
+}
+
+void EpochDomain::exit() {
+    ThreadState& state = threadState;
+    if (--state.depth == 0) {
+        state.slot->epoch.store(0, std::memory_order_release);
+    }
+}
+
+std::uint64_t EpochDomain::oldestPinnedEpoch() const {
+    std::uint64_t oldest = UINT64_MAX;
+    for (const SlotBlock* block = &firstBlock; block; block = block->next.load()) {
+        for (const ReaderSlot& slot : block->slots) {
+            std::uint64_t epoch = slot.epoch.load();
+            if (epoch != 0) oldest = std::min(oldest, epoch);
+        }
+    }
+    return oldest;
+}
+
+// Readers pinned after the bump load snapshots after the pointer was unpublished
+void EpochDomain::retire(void* pointer, void (*destroy)(void*)) {
+    std::uint64_t epoch = globalEpoch.fetch_add(1);
+
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        retired.push_back(Retired{epoch, pointer, destroy});
+        std::uint64_t oldest = oldestPinnedEpoch();
+        auto keep = std::partition(retired.begin(), retired.end(),
+            [oldest](const Retired& entry) { return entry.epoch >= oldest; });
+        ready.assign(keep, retired.end());
+        retired.erase(keep, retired.end());
+    }
+    for (const Retired& entry : ready) {
+        entry.destroy(entry.pointer);
+    }
+}
+
+void EpochDomain::synchronize() {
+    std::uint64_t epoch = globalEpoch.fetch_add(1);
+    for (const SlotBlock* block = &firstBlock; block; block = block->next.load()) {
+        for (const ReaderSlot& slot : block->slots) {
+            while (true) {
+                std::uint64_t pinned = slot.epoch.load();
+                if (pinned == 0 || pinned > epoch) break;
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+EpochGuard::EpochGuard() { EpochDomain::global().enter(); }
+EpochGuard::~EpochGuard() { EpochDomain::global().exit(); }
+
+Topic::Topic(std::string name, std::string description, std::size_t partitionCount, TopicId handle)
+    : name(name), handle(handle), description(description), subscriptions(new std::vector<Subscription>()),
+      active(true), partitionCount(partitionCount > 0 ? partitionCount : 1), nextPartition(0), ttlMillis(0),
+      groupList(new std::vector<ConsumerGroup*>()) {}
+
+Topic::~Topic() {
+    EpochDomain::global().retire(subscriptions.load());
+    EpochDomain::global().retire(groupList.load());
+}
+
+const std::string& Topic::getName() const { return name; }
+TopicId Topic::getHandle() const { return handle; }
+std::string Topic::getDescription() const { return description; }
+bool Topic::isActive() const { return active; }
+std::size_t Topic::getPartitionCount() const { return partitionCount; }
+
+ConsumerGroup* Topic::getGroup(const std::string& groupName) const {
+    std::lock_guard<std::mutex> lock(groupMutex);
+    auto it = groups.find(groupName);
+    return it != groups.end() ? it->second.get() : nullptr;
+}
+
+std::vector<Subcriber*> Topic::getSubcribers() const {
+    std::vector<Subcriber*> res;
+
+    EpochGuard guard;
+    for (const Subscription& subscription : *subscriptions.load()) {
+        res.push_back(subscription.subcriber);
+    }
+    return res;
+}
+
+void Topic::replaceSubscriptions(const std::vector<Subscription>* next) {
+    const std::vector<Subscription>* previous = subscriptions.exchange(next);
+    EpochDomain::global().retire(previous);
+}
+
+void Topic::addSubscriber(Subcriber* subcriber, std::shared_ptr<const ContentFilter> filter) {
+    if (!subcriber) return;
+
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    auto next = new std::vector<Subscription>(*subscriptions.load());
+    auto it = subscriptionIndex.find(subcriber);
+    if (it != subscriptionIndex.end()) {
+        (*next)[it->second].filter = std::move(filter);
+    }
+    else {
+        subscriptionIndex[subcriber] = next->size();
+        next->push_back(Subscription{subcriber, std::move(filter)});
+    }
+    replaceSubscriptions(next);
+}
+
+void Topic::removeSubscriber(Subcriber* subcriber) {
+    if (!subcriber) return;
+
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    auto it = subscriptionIndex.find(subcriber);
+    if (it == subscriptionIndex.end()) return;
+
+    // Swap with the last entry to keep the array dense
+    auto next = new std::vector<Subscription>(*subscriptions.load());
+    std::size_t index = it->second;
+    subscriptionIndex.erase(it);
+    if (index + 1 != next->size()) {
+        (*next)[index] = std::move(next->back());
+        subscriptionIndex[(*next)[index].subcriber] = index;
+    }
+    next->pop_back();
+    replaceSubscriptions(next);
+}
+
+// Runs each distinct filter once per message, then delivers to every subscriber once
+// with the messages that passed any of its subscriptions
+void Topic::fanOut(Message* const* messages, std::size_t count, const std::vector<Subscription>& patternSubscriptions) {
+    EpochGuard guard;
+    const std::vector<Subscription>& subscriptions = *this->subscriptions.load();
+
+    auto receiveAll = [messages, count](Subcriber* subcriber) {
+        if (count == 1) {
+            subcriber->receiveMessage(messages[0]);
+        }
+        else {
+            subcriber->receiveBatch(messages, count);
+        }
+    };
+    auto unfiltered = [](const Subscription& subscription) { return !subscription.filter; };
+    if (std::all_of(subscriptions.begin(), subscriptions.end(), unfiltered)
+        && std::all_of(patternSubscriptions.begin(), patternSubscriptions.end(), unfiltered)) {
+        // Fast path: every subscriber gets every message. Direct subscribers are
+        // already unique; only pattern matches can repeat one.
+        if (patternSubscriptions.empty()) {
+            for (const Subscription& subscription : subscriptions) {
+                receiveAll(subscription.subcriber);
+            }
+            return;
+        }
+        std::vector<Subcriber*> targets;
+        targets.reserve(subscriptions.size() + patternSubscriptions.size());
+        for (const Subscription& subscription : subscriptions) {
+            targets.push_back(subscription.subcriber);
+        }
+        for (const Subscription& subscription : patternSubscriptions) {
+            targets.push_back(subscription.subcriber);
+        }
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+        for (Subcriber* subcriber : targets) {
+            receiveAll(subcriber);
+        }
+        return;
+    }
+
+    std::vector<const Subscription*> candidates;
+    candidates.reserve(subscriptions.size() + patternSubscriptions.size());
+    for (const Subscription& subscription : subscriptions) {
+        candidates.push_back(&subscription);
+    }
+    for (const Subscription& subscription : patternSubscriptions) {
+        candidates.push_back(&subscription);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Subscription* a, const Subscription* b) {
+        return a->filter.get() < b->filter.get();
+    });
+
+    std::vector<std::vector<char>> masks;
+    masks.reserve(candidates.size());
+    std::vector<std::pair<Subcriber*, const std::vector<char>*>> selected; // nullptr mask passes all
+    selected.reserve(candidates.size());
+    for (std::size_t i = 0; i < candidates.size();) {
+        const ContentFilter* filter = candidates[i]->filter.get();
+        const std::vector<char>* mask = nullptr;
+        if (filter) {
+            masks.emplace_back(count);
+            for (std::size_t m = 0; m < count; m++) {
+                masks.back()[m] = filter->matches(*messages[m]);
+            }
+            mask = &masks.back();
+        }
+        for (; i < candidates.size() && candidates[i]->filter.get() == filter; i++) {
+            selected.emplace_back(candidates[i]->subcriber, mask);
+        }
+    }
+    std::sort(selected.begin(), selected.end());
+
+    std::vector<Message*> passed;
+    for (std::size_t i = 0; i < selected.size();) {
+        Subcriber* subcriber = selected[i].first;
+        std::size_t end = i;
+        bool passesAll = false;
+        while (end < selected.size() && selected[end].first == subcriber) {
+            passesAll = passesAll || selected[end].second == nullptr;
+            end++;
+        }
+
+        passed.clear();
+        for (std::size_t m = 0; m < count; m++) {
+            bool keep = passesAll;
+            for (std::size_t k = i; k < end && !keep; k++) {
+                keep = (*selected[k].second)[m];
+            }
+            if (keep) passed.push_back(messages[m]);
+        }
+        if (passed.size() == 1) {
+            subcriber->receiveMessage(passed[0]);
+        }
+        else if (!passed.empty()) {
+            subcriber->receiveBatch(passed.data(), passed.size());
+        }
+        i = end;
+    }
+}
+
+void Topic::publishMessage(Message* message, const std::vector<Subscription>& patternSubscriptions) {
+    if (!active) return;
+
+    fanOut(&message, 1, patternSubscriptions);
+    deliverToGroups(&message, 1);
+}
+
+void Topic::publishBatch(Message* const* messages, std::size_t count,
+    const std::vector<Subscription>& patternSubscriptions) {
+    if (!active || count == 0) return;
+
+    fanOut(messages, count, patternSubscriptions);
+    deliverToGroups(messages, count);
+}
+
+// Each message goes to the single member owning its partition, batched per owner
+void Topic::deliverToGroups(Message* const* messages, std::size_t count) {
+    EpochGuard guard;
+    for (ConsumerGroup* group : *groupList.load()) {
+        if (count == 1) {
+            Subcriber* owner = group->getOwner(messages[0]->getPartition());
+            if (owner) owner->receiveMessage(messages[0]);
+            continue;
+        }
+
+        std::vector<std::pair<Subcriber*, std::vector<Message*>>> byOwner;
+        for (std::size_t i = 0; i < count; i++) {
+            Subcriber* owner = group->getOwner(messages[i]->getPartition());
+            if (!owner) continue;
+
+            auto entry = std::find_if(byOwner.begin(), byOwner.end(),
+                [owner](const auto& pair) { return pair.first == owner; });
+            if (entry == byOwner.end()) {
+                byOwner.emplace_back(owner, std::vector<Message*>());
+                entry = byOwner.end() - 1;
+            }
+            entry->second.push_back(messages[i]);
+        }
+        for (auto& [owner, owned] : byOwner) {
+            owner->receiveBatch(owned.data(), owned.size());
+        }
+    }
+}
+
+void Topic::assignPartition(Message* message, std::string_view key) {
+    if (partitionCount == 1) return;
+
+    if (key.empty()) {
+        message->partition = nextPartition.fetch_add(1, std::memory_order_relaxed) % partitionCount;
+    }
+    else {
+        message->partition = std::hash<std::string_view>()(key) % partitionCount;
+    }
+}
+
+// Messages that already carry a deadline keep it
+void Topic::assignExpiry(Message* const* messages, std::size_t count, std::int64_t ttlMillis) {
+    if (ttlMillis <= 0) ttlMillis = this->ttlMillis.load(std::memory_order_relaxed);
+    if (ttlMillis <= 0) return;
+
+    std::int64_t deadline = steadyNowMillis() + ttlMillis;
+    for (std::size_t i = 0; i < count; i++) {
+        if (messages[i]->expiresAt == 0) messages[i]->expiresAt = deadline;
+    }
+}
+
+void Topic::setTtl(std::chrono::milliseconds ttl) {
+    ttlMillis.store(ttl.count(), std::memory_order_relaxed);
+}
+
+std::chrono::milliseconds Topic::getTtl() const {
+    return std::chrono::milliseconds(ttlMillis.load(std::memory_order_relaxed));
+}
+
+bool Topic::joinGroup(const std::string& groupName, Subcriber* subcriber) {
+    ConsumerGroup* group;
+    {
+        std::lock_guard<std::mutex> lock(groupMutex);
+        auto it = groups.find(groupName);
+        if (it == groups.end()) {
+            it = groups.emplace(groupName, std::make_unique<ConsumerGroup>(groupName, partitionCount)).first;
+            auto next = new std::vector<ConsumerGroup*>(*groupList.load());
+            next->push_back(it->second.get());
+            EpochDomain::global().retire(groupList.exchange(next));
+        }
+        group = it->second.get();
+    }
+    return group->addMember(subcriber);
+}
+
+bool Topic::leaveGroup(const std::string& groupName, Subcriber* subcriber) {
+    ConsumerGroup* group = getGroup(groupName);
+    return group && group->removeMember(subcriber);
+}
 
-Subcriber::Subcriber(std::string subcriberId, std::string name)
-    : subcriberId(subcriberId), name(name), active(true) {}
+void Topic::leaveAllGroups(Subcriber* subcriber) {
+    EpochGuard guard;
+    for (ConsumerGroup* group : *groupList.load()) {
+        group->removeMember(subcriber);
+    }
+}
 
-std::string Subcriber::getId() const { return subcriberId; }
-std::string Subcriber::getName() const { return name; }
-bool Subcriber::isActive() const { return active; }
-const std::vector<Message*>& Subcriber::getMessageQueue() const { return messageQueue; }
+void Topic::setActive(bool status) {
+    active = status;
+}
+
+bool Topic::openLog(const std::string& rootDirectory, const LogConfig& config) {
+    if (log) return true;
+
+    std::string directory = rootDirectory + "/" + TopicLog::escapeName(name);
+    auto topicLog = std::make_unique<TopicLog>(name, directory, config);
+    if (!topicLog->open()) return false;
+    log = std::move(topicLog);
+    return true;
+}
 
-void Subcriber::receiveMessage(Message* message) {
-    if (active) {
-        messageQueue.push_back(message);
-        std::cout << name << " received a new message\n" << std::endl;
+TopicLog* Topic::getLog() const { return log.get(); }
+
+std::vector<std::string_view> TopicTrie::splitSegments(std::string_view topicName) {
+    std::vector<std::string_view> segments;
+    std::size_t start = 0;
+    while (true) {
+        std::size_t end = topicName.find('/', start);
+        if (end == std::string_view::npos) {
+            segments.push_back(topicName.substr(start));
+            return segments;
+        }
+        segments.push_back(topicName.substr(start, end - start));
+        start = end + 1;
     }
 }
 
-void Subcriber::clearMessage() {
-    messageQueue.clear();
+bool TopicTrie::isPattern(std::string_view topicName) {
+    for (std::string_view segment : splitSegments(topicName)) {
+        if (segment == "*" || segment == "#") return true;
+    }
+    return false;
 }
 
-void Subcriber::setActive(bool status) {
-    active = status;
+bool TopicTrie::isValidPattern(std::string_view pattern) {
+    std::vector<std::string_view> segments = splitSegments(pattern);
+    for (std::size_t i = 0; i + 1 < segments.size(); i++) {
+        if (segments[i] == "#") return false;
+    }
+    return true;
 }
 
-Topic::Topic(std::string name, std::string description)
-    : name(name), description(description), active(true) {}
+TopicTrie::TopicTrie() : root(new Node()) {}
 
-std::string Topic::getName() const { return name; }
-std::string Topic::getDescription() const { return description; }
-bool Topic::isActive() const { return active; }
-std::vector<Subcriber*> Topic::getSubcribers() const {
-    std::vector<Subcriber*> res;
+TopicTrie::~TopicTrie() {
+    EpochDomain::global().retire(root.load());
+}
 
-    for (auto it = subcribers_map.begin(); it != subcribers_map.end(); it++) {
-        res.push_back(it->second);
+void TopicTrie::replaceRoot(const Node* next) {
+    const Node* previous = root.exchange(next);
+    EpochDomain::global().retire(previous);
+}
+
+// Missing nodes are created. The replaced originals stay reachable from the old
+// root, which is retired as a whole, so readers still inside it are unaffected.
+std::vector<TopicTrie::Node*> TopicTrie::copyPath(Node* next, const std::vector<std::string_view>& segments) {
+    std::vector<Node*> path{next};
+    for (std::string_view segment : segments) {
+        Node* node = path.back();
+        auto it = node->children.find(segment);
+        if (it == node->children.end()) {
+            it = node->children.emplace(std::string(segment), std::make_shared<Node>()).first;
+        }
+        else {
+            it->second = std::make_shared<Node>(*it->second);
+        }
+        path.push_back(it->second.get());
     }
-    return res;
+    return path;
 }
 
-void Topic::addSubscriber(Subcriber* subcriber) {
-    if (!subcriber) return;
-    subcribers_map[subcriber->getId()] = subcriber;
+bool TopicTrie::insert(std::string_view pattern, Subcriber* subcriber, std::shared_ptr<const ContentFilter> filter) {
+    if (!subcriber || !isValidPattern(pattern)) return false;
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    Node* next = new Node(*root.load());
+    Node* node = copyPath(next, splitSegments(pattern)).back();
+    auto it = std::find_if(node->subscriptions.begin(), node->subscriptions.end(),
+        [subcriber](const Subscription& subscription) { return subscription.subcriber == subcriber; });
+    if (it != node->subscriptions.end()) {
+        it->filter = std::move(filter); // resubscribing replaces the filter
+    }
+    else {
+        node->subscriptions.push_back(Subscription{subcriber, std::move(filter)});
+        patternsBySubcriber[subcriber].emplace_back(pattern);
+    }
+    replaceRoot(next);
+    return true;
 }
 
-void Topic::removeSubscriber(Subcriber* subcriber) {
-    if (!subcriber) return;
-    auto it = subcribers_map.find(subcriber->getId());
-    if (it != subcribers_map.end()) {
-        subcribers_map.erase(it);
+// The pattern is known to be subscribed; nodes left empty are pruned
+void TopicTrie::removeFromCopy(Node* next, std::string_view pattern, Subcriber* subcriber) {
+    std::vector<std::string_view> segments = splitSegments(pattern);
+    std::vector<Node*> path = copyPath(next, segments);
+    std::vector<Subscription>& subscriptions = path.back()->subscriptions;
+    subscriptions.erase(std::find_if(subscriptions.begin(), subscriptions.end(),
+        [subcriber](const Subscription& subscription) { return subscription.subcriber == subcriber; }));
+    for (std::size_t depth = segments.size(); depth > 0; depth--) {
+        if (!path[depth]->subscriptions.empty() || !path[depth]->children.empty()) break;
+        auto& siblings = path[depth - 1]->children;
+        siblings.erase(siblings.find(segments[depth - 1]));
     }
 }
 
-void Topic::publishMessage(Message* message) {
-    if (!active) return;
+bool TopicTrie::remove(std::string_view pattern, Subcriber* subcriber) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    auto owned = patternsBySubcriber.find(subcriber);
+    if (owned == patternsBySubcriber.end()) return false;
+    auto it = std::find(owned->second.begin(), owned->second.end(), pattern);
+    if (it == owned->second.end()) return false;
 
-    std::cout << "A new message is broad casting - " << message->getTopic() << std::endl;
-    std::cout << "Content: " << message->getContent() << std::endl; 
-    for (auto it = subcribers_map.begin(); it != subcribers_map.end(); it++) {
-        it->second->receiveMessage(message);
+    owned->second.erase(it);
+    if (owned->second.empty()) patternsBySubcriber.erase(owned);
+    Node* next = new Node(*root.load());
+    removeFromCopy(next, pattern, subcriber);
+    replaceRoot(next);
+    return true;
+}
+
+void TopicTrie::removeAll(Subcriber* subcriber) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    auto owned = patternsBySubcriber.find(subcriber);
+    if (owned == patternsBySubcriber.end()) return;
+
+    Node* next = new Node(*root.load());
+    for (const std::string& pattern : owned->second) {
+        removeFromCopy(next, pattern, subcriber);
     }
+    patternsBySubcriber.erase(owned);
+    replaceRoot(next);
 }
 
-void Topic::setActive(bool status) {
-    active = status;
+void TopicTrie::matchNode(const Node* node, const std::vector<std::string_view>& segments,
+    std::size_t depth, std::vector<Subscription>& out) {
+    auto multi = node->children.find(std::string_view("#"));
+    if (multi != node->children.end()) {
+        out.insert(out.end(), multi->second->subscriptions.begin(), multi->second->subscriptions.end());
+    }
+    if (depth == segments.size()) {
+        out.insert(out.end(), node->subscriptions.begin(), node->subscriptions.end());
+        return;
+    }
+
+    auto exact = node->children.find(segments[depth]);
+    if (exact != node->children.end()) {
+        matchNode(exact->second.get(), segments, depth + 1, out);
+    }
+    auto single = node->children.find(std::string_view("*"));
+    if (single != node->children.end()) {
+        matchNode(single->second.get(), segments, depth + 1, out);
+    }
 }
 
-PubSubSystem::PubSubSystem() : subscriberIdCounter(1) {}
+void TopicTrie::match(std::string_view topicName, std::vector<Subscription>& out) const {
+    EpochGuard guard;
+    matchNode(root.load(), splitSegments(topicName), 0, out);
+}
 
-Topic* PubSubSystem::createTopic(std::string name, std::string description) {
-    if (findTopic(name)) return nullptr;
+Dispatcher::Dispatcher(std::size_t numWorkers, DeliverFn deliver, std::size_t queueCapacity)
+    : deliver(std::move(deliver)), queueCapacity(queueCapacity > 0 ? queueCapacity : 1) {
+    if (numWorkers == 0) numWorkers = 1;
+    for (std::size_t i = 0; i < numWorkers; i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    for (auto& shard : shards) {
+        Shard* target = shard.get();
+        shard->worker = std::thread([this, target] { run(*target); });
+    }
+}
 
-    Topic* topic = new Topic(name, description);
-    topics_map[name] = topic;
-    return topic;
+Dispatcher::~Dispatcher() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mtx);
+        shard->stopping = true;
+        shard->taskCond.notify_one();
+    }
+    for (auto& shard : shards) {
+        shard->worker.join();
+    }
 }
 
-void PubSubSystem::removeTopic(std::string name) {
-    for (auto it = topics_map.begin(); it != topics_map.end(); it++) {
-        if (it->first == name) {
-            topics_map.erase(it);
-            return;
+std::size_t Dispatcher::getWorkerCount() const { return shards.size(); }
+
+// Topic handles are dense, so they spread round robin over the shards. Topic
+// pointers would not: they are aligned, and std::hash leaves them unchanged.
+Dispatcher::Shard& Dispatcher::shardFor(Topic* topic) {
+    TopicId handle = topic->getHandle();
+    std::size_t hash = handle.isValid() ? handle.value : std::hash<std::string>()(topic->getName());
+    return *shards[hash % shards.size()];
+}
+
+void Dispatcher::dispatch(Topic* topic, Message* const* messages, std::size_t count) {
+    if (count == 0) return;
+
+    Task task{topic, messages[0], {}};
+    if (count > 1) task.batch.assign(messages, messages + count);
+
+    Shard& shard = shardFor(topic);
+    {
+        std::unique_lock<std::mutex> lock(shard.mtx);
+        shard.spaceCond.wait(lock, [this, &shard] { return shard.tasks.size() < queueCapacity; });
+        shard.tasks.push_back(std::move(task));
+        shard.enqueued++;
+    }
+    shard.taskCond.notify_one();
+}
+
+void Dispatcher::run(Shard& shard) {
+    std::unique_lock<std::mutex> lock(shard.mtx);
+    while (true) {
+        shard.taskCond.wait(lock, [&shard] { return shard.stopping || !shard.tasks.empty(); });
+        if (shard.tasks.empty()) return; // stopping and fully drained
+
+        Task task = std::move(shard.tasks.front());
+        shard.tasks.pop_front();
+        lock.unlock();
+        shard.spaceCond.notify_one();
+
+        Message* const* messages = task.batch.empty() ? &task.message : task.batch.data();
+        std::size_t count = task.batch.empty() ? 1 : task.batch.size();
+        deliver(task.topic, messages, count);
+        for (std::size_t i = 0; i < count; i++) {
+            messages[i]->release();
+        }
+
+        lock.lock();
+        shard.completed++;
+        shard.completedCond.notify_all();
+    }
+}
+
+// Waits for the tasks queued before the call only, so publishers that never
+// pause cannot keep it waiting
+void Dispatcher::flush() {
+    std::vector<std::uint64_t> targets;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mtx);
+        targets.push_back(shard->enqueued);
+    }
+    for (std::size_t i = 0; i < shards.size(); i++) {
+        Shard& shard = *shards[i];
+        std::unique_lock<std::mutex> lock(shard.mtx);
+        shard.completedCond.wait(lock, [&shard, target = targets[i]] { return shard.completed >= target; });
+    }
+}
+
+PubSubSystem::PubSubSystem(std::size_t dispatcherThreads)
+    : topics(new TopicRegistry()), subscriberIdCounter(1), persistent(false), expiryWheel(1, steadyNowMillis()), expiryStopping(false) {
+    if (dispatcherThreads > 0) {
+        dispatcher = std::make_unique<Dispatcher>(dispatcherThreads,
+            [this](Topic* topic, Message* const* messages, std::size_t count) {
+                deliver(topic, messages, count);
+            });
+    }
+}
+
+PubSubSystem::~PubSubSystem() {
+    if (expiryThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(expiryThreadMutex);
+            expiryStopping = true;
         }
+        expiryCond.notify_one();
+        expiryThread.join();
     }
+    dispatcher.reset(); // finish in-flight deliveries before tearing down
+    const TopicRegistry* registry = topics.load();
+    for (auto it = registry->byName.begin(); it != registry->byName.end(); it++) {
+        delete it->second;
+    }
+    delete registry;
+    for (auto it = subcribers_map.begin(); it != subcribers_map.end(); it++) {
+        it->second->close();
+        delete it->second; // releases any undrained messages
+    }
+}
+
+Topic* PubSubSystem::createTopic(std::string name, std::string description, std::size_t partitionCount) {
+    std::lock_guard<std::mutex> lock(topicMutex);
+    const TopicRegistry* registry = topics.load();
+    if (registry->byName.count(name)) return nullptr;
+
+    Topic* topic = new Topic(name, description, partitionCount, TopicId{(std::uint32_t)registry->byId.size()});
+    if (persistent) topic->openLog(logDirectory, logConfig); // before publishers can see it
+    TopicRegistry* next = new TopicRegistry(*registry);
+    next->byName[name] = topic;
+    next->byId.push_back(topic);
+    replaceTopics(next);
+    return topic;
+}
+
+void PubSubSystem::removeTopic(std::string name) {
+    std::lock_guard<std::mutex> lock(topicMutex);
+    const TopicRegistry* registry = topics.load();
+    auto it = registry->byName.find(name);
+    if (it == registry->byName.end()) return;
+
+    Topic* topic = it->second;
+    TopicRegistry* next = new TopicRegistry(*registry);
+    next->byName.erase(name);
+    next->byId[topic->getHandle().value] = nullptr; // handles are never reused
+    replaceTopics(next);
+    EpochDomain::global().synchronize(); // no caller may still be using the topic
+    flush(); // nor any delivery those callers queued
+    delete topic;
+}
+
+void PubSubSystem::replaceTopics(const TopicRegistry* next) {
+    EpochDomain::global().retire(topics.exchange(next));
 }
 
-Subcriber* PubSubSystem::addSubcriber(std::string name) {
+Subcriber* PubSubSystem::addSubcriber(std::string name,
+    std::size_t mailboxCapacity, OverflowPolicy policy) {
+    std::unique_lock<std::shared_mutex> registryLock(subcriberMutex);
     std::string subcriberId = generateSubcriberId();
-    Subcriber* subcriber = new Subcriber(subcriberId, name);
+    SubscriberId handle{(std::uint32_t)subcribersById.size()};
+    Subcriber* subcriber = new Subcriber(subcriberId, name, mailboxCapacity, policy, handle);
+    subcriber->setExpiryWheel(&expiryWheel);
     subcribers_map[subcriberId] = subcriber;
+    subcribersById.push_back(subcriber);
     return subcriber;
 }
 
@@ -106,8 +1491,189 @@ std::string PubSubSystem::generateSubcriberId() {
 }
 
 
+bool PubSubSystem::removeSubcriber(std::string subcriberId) {
+    std::unique_lock<std::shared_mutex> registryLock(subcriberMutex);
+    auto it = subcribers_map.find(subcriberId);
+    if (it == subcribers_map.end()) return false;
+
+    Subcriber* subcriber = it->second;
+    {
+        EpochGuard guard;
+        const TopicRegistry* registry = topics.load();
+        for (auto topic = registry->byName.begin(); topic != registry->byName.end(); topic++) {
+            topic->second->removeSubscriber(subcriber);
+            topic->second->leaveAllGroups(subcriber); // hands its partitions to the remaining members
+        }
+    }
+    patternSubscriptions.removeAll(subcriber);
+    flush(); // no queued delivery may still reference the subscriber
+    EpochDomain::global().synchronize(); // nor any publisher still walking an old snapshot
+    subcriber->close();
+
+    std::lock_guard<std::mutex> lock(expiryMutex);
+    expiryWheel.cancel(subcriber);
+    subcribersById[subcriber->getHandle().value] = nullptr;
+    subcribers_map.erase(it);
+    delete subcriber;
+    return true;
+}
+
 bool PubSubSystem::subscribe(std::string subcriberId, std::string topicName) {
+    return addSubscription(subcriberId, topicName, nullptr);
+}
+
+bool PubSubSystem::subscribe(std::string subcriberId, std::string topicName, FilterSpec filter) {
+    return addSubscription(subcriberId, topicName, compileFilter(std::move(filter)));
+}
+
+// Identical specs share one compiled filter so fan-out evaluates it once per message
+std::shared_ptr<const ContentFilter> PubSubSystem::compileFilter(FilterSpec spec) {
+    std::string key = ContentFilter::canonicalKey(spec);
+    std::lock_guard<std::mutex> lock(filterMutex);
+    auto it = filters.find(key);
+    if (it != filters.end()) {
+        if (auto existing = it->second.lock()) return existing;
+    }
+    auto filter = std::make_shared<const ContentFilter>(std::move(spec));
+    filters[key] = filter;
+    return filter;
+}
+
+bool PubSubSystem::addSubscription(const std::string& subcriberId, const std::string& topicName,
+    std::shared_ptr<const ContentFilter> filter) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    if (!subcriber) return false;
+
+    if (TopicTrie::isPattern(topicName)) {
+        return patternSubscriptions.insert(topicName, subcriber, std::move(filter));
+    }
+    Topic* topic = findTopic(topicName);
+    if (!topic) return false;
+
+    topic->addSubscriber(subcriber, std::move(filter));
+    return true;
+}
+
+bool PubSubSystem::unsubscribe(std::string subcriberId, std::string topicName) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    if (!subcriber) return false;
+
+    if (TopicTrie::isPattern(topicName)) {
+        return patternSubscriptions.remove(topicName, subcriber);
+    }
+    Topic* topic = findTopic(topicName);
+    if (!topic) return false;
+
+    topic->removeSubscriber(subcriber);
+    return true;
+}
+
+bool PubSubSystem::joinGroup(std::string subcriberId, std::string topicName, std::string groupName) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Topic* topic = findTopic(topicName);
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    if (!topic || !subcriber) return false;
+
+    return topic->joinGroup(groupName, subcriber);
+}
+
+bool PubSubSystem::leaveGroup(std::string subcriberId, std::string topicName, std::string groupName) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Topic* topic = findTopic(topicName);
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    if (!topic || !subcriber) return false;
+
+    return topic->leaveGroup(groupName, subcriber);
+}
+
+bool PubSubSystem::publish(std::string topicName, std::string content) {
+    return publish(std::move(topicName), std::move(content), std::string_view());
+}
+
+bool PubSubSystem::publish(std::string topicName, std::string content, std::string_view key) {
+    return publish(std::move(topicName), std::move(content), Headers(), key);
+}
+
+bool PubSubSystem::publish(std::string topicName, std::string content, Headers headers, std::string_view key) {
+    EpochGuard guard;
+    return publishTo(findTopic(topicName), std::move(content), std::move(headers), key);
+}
+
+bool PubSubSystem::publishTo(Topic* topic, std::string content, Headers headers, std::string_view key) {
+    if (!topic || !topic->isActive()) return false;
+
+    Message* message = new Message(topic->getName(), std::move(content), std::move(headers));
+    topic->assignPartition(message, key);
+    route(topic, &message, 1);
+    return true;
+}
+
+std::size_t PubSubSystem::publishBatch(const std::string& topicName, std::span<const std::string> contents) {
+    EpochGuard guard;
+    return publishBatchTo(findTopic(topicName), contents);
+}
+
+std::size_t PubSubSystem::publishBatchTo(Topic* topic, std::span<const std::string> contents) {
+    if (!topic || !topic->isActive() || contents.empty()) return 0;
+
+    return routeBlock(topic, Message::createBatch(topic->getName(), contents), contents.size());
+}
+
+std::size_t PubSubSystem::publishBatchTo(Topic* topic, std::span<const std::string_view> contents) {
+    if (!topic || !topic->isActive() || contents.empty()) return 0;
+
+    return routeBlock(topic, Message::createBatch(topic->getName(), contents), contents.size());
+}
+
+std::size_t PubSubSystem::routeBlock(Topic* topic, Message* block, std::size_t count) {
+    std::vector<Message*> messages(count);
+    for (std::size_t i = 0; i < count; i++) {
+        messages[i] = &block[i];
+        topic->assignPartition(messages[i], std::string_view());
+    }
+    route(topic, messages.data(), messages.size());
+    return count;
+}
+
+// Contents are viewed in place and copied once, into their messages
+std::size_t PubSubSystem::publishBatch(std::span<const std::pair<std::string, std::string>> topicContents) {
+    EpochGuard guard;
+    std::size_t published = 0;
+    std::vector<std::string_view> run;
+    std::size_t end;
+    for (std::size_t start = 0; start < topicContents.size(); start = end) {
+        const std::string& topicName = topicContents[start].first;
+        run.clear();
+        for (end = start; end < topicContents.size() && topicContents[end].first == topicName; end++) {
+            run.push_back(topicContents[end].second);
+        }
+        published += publishBatchTo(findTopic(topicName), run);
+    }
+    return published;
+}
+
+TopicId PubSubSystem::getTopicId(const std::string& topicName) const {
+    EpochGuard guard;
     Topic* topic = findTopic(topicName);
+    return topic ? topic->getHandle() : TopicId();
+}
+
+SubscriberId PubSubSystem::getSubscriberId(const std::string& subcriberId) const {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    return subcriber ? subcriber->getHandle() : SubscriberId();
+}
+
+bool PubSubSystem::subscribe(SubscriberId subcriberId, TopicId topicId) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Topic* topic = findTopic(topicId);
     Subcriber* subcriber = findSubcriber(subcriberId);
     if (!topic || !subcriber) return false;
 
@@ -115,35 +1681,214 @@ bool PubSubSystem::subscribe(std::string subcriberId, std::string topicName) {
     return true;
 }
 
-bool PubSubSystem::publish(std::string topicName, std::string content) {
+bool PubSubSystem::subscribe(SubscriberId subcriberId, TopicId topicId, FilterSpec filter) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Topic* topic = findTopic(topicId);
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    if (!topic || !subcriber) return false;
+
+    topic->addSubscriber(subcriber, compileFilter(std::move(filter)));
+    return true;
+}
+
+bool PubSubSystem::unsubscribe(SubscriberId subcriberId, TopicId topicId) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Topic* topic = findTopic(topicId);
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    if (!topic || !subcriber) return false;
+
+    topic->removeSubscriber(subcriber);
+    return true;
+}
+
+bool PubSubSystem::publish(TopicId topicId, std::string content) {
+    EpochGuard guard;
+    return publishTo(findTopic(topicId), std::move(content), Headers(), std::string_view());
+}
+
+bool PubSubSystem::publish(TopicId topicId, std::string content, std::string_view key) {
+    EpochGuard guard;
+    return publishTo(findTopic(topicId), std::move(content), Headers(), key);
+}
+
+std::size_t PubSubSystem::publishBatch(TopicId topicId, std::span<const std::string> contents) {
+    EpochGuard guard;
+    return publishBatchTo(findTopic(topicId), contents);
+}
+
+void PubSubSystem::flush() {
+    if (dispatcher) dispatcher->flush();
+}
+
+bool PubSubSystem::publishWithTtl(std::string topicName, std::string content, std::chrono::milliseconds ttl) {
+    EpochGuard guard;
     Topic* topic = findTopic(topicName);
     if (!topic || !topic->isActive()) return false;
 
-    Message* message = new Message(topicName, content);
-    topic->publishMessage(message);
+    Message* message = new Message(topicName, std::move(content));
+    topic->assignPartition(message, std::string_view());
+    topic->assignExpiry(&message, 1, ttl.count());
+    route(topic, &message, 1);
     return true;
 }
 
-Topic* PubSubSystem::findTopic(std::string topicName) const {
-    for (auto it = topics_map.begin(); it != topics_map.end(); it++) {
-        if (it->first == topicName) {
-            return it->second;
+bool PubSubSystem::setTopicTtl(std::string topicName, std::chrono::milliseconds ttl) {
+    EpochGuard guard;
+    Topic* topic = findTopic(topicName);
+    if (!topic) return false;
+
+    topic->setTtl(ttl);
+    return true;
+}
+
+std::size_t PubSubSystem::expireMessages() {
+    std::lock_guard<std::mutex> lock(expiryMutex);
+    std::int64_t now = steadyNowMillis();
+    std::vector<std::pair<Subcriber*, std::size_t>> due;
+    expiryWheel.advance(now, due);
+
+    std::size_t expired = 0;
+    for (const auto& [subcriber, position] : due) {
+        expired += subcriber->expireMessage(position, now);
+    }
+    return expired;
+}
+
+void PubSubSystem::startExpiry(std::chrono::milliseconds interval) {
+    if (expiryThread.joinable()) return;
+
+    expiryThread = std::thread([this, interval] {
+        std::unique_lock<std::mutex> lock(expiryThreadMutex);
+        while (!expiryCond.wait_for(lock, interval, [this] { return expiryStopping; })) {
+            lock.unlock();
+            expireMessages();
+            lock.lock();
         }
+    });
+}
+
+bool PubSubSystem::enablePersistence(std::string directory, LogConfig config) {
+    std::lock_guard<std::mutex> lock(topicMutex);
+    persistent = true;
+    logDirectory = std::move(directory);
+    logConfig = config;
+
+    bool opened = true;
+    const TopicRegistry* registry = topics.load(); // stable while topicMutex is held
+    for (auto it = registry->byName.begin(); it != registry->byName.end(); it++) {
+        opened = it->second->openLog(logDirectory, logConfig) && opened;
+    }
+    return opened;
+}
+
+std::size_t PubSubSystem::replay(std::string subcriberId, std::string topicName,
+    std::uint64_t fromOffset, std::size_t maxMessages) {
+    std::shared_lock<std::shared_mutex> registryLock(subcriberMutex);
+    EpochGuard guard;
+    Topic* topic = findTopic(topicName);
+    Subcriber* subcriber = findSubcriber(subcriberId);
+    if (!topic || !subcriber || !topic->getLog()) return 0;
+
+    std::vector<Message*> messages;
+    topic->getLog()->read(fromOffset, maxMessages, messages);
+    std::size_t delivered = subcriber->receiveBatch(messages.data(), messages.size());
+    for (Message* message : messages) {
+        message->release();
+    }
+    return delivered;
+}
+
+std::size_t PubSubSystem::replaySince(std::string subcriberId, std::string topicName,
+    std::time_t since, std::size_t maxMessages) {
+    std::uint64_t fromOffset;
+    {
+        EpochGuard guard; // left before replay takes subcriberMutex
+        Topic* topic = findTopic(topicName);
+        if (!topic || !topic->getLog()) return 0;
+        fromOffset = topic->getLog()->findOffset(since);
+    }
+    return replay(subcriberId, topicName, fromOffset, maxMessages);
+}
+
+bool PubSubSystem::commitOffset(std::string consumerName, std::string topicName, std::uint64_t offset) {
+    EpochGuard guard;
+    Topic* topic = findTopic(topicName);
+    if (!topic || !topic->getLog()) return false;
+
+    return topic->getLog()->commit(consumerName, offset);
+}
+
+std::uint64_t PubSubSystem::getCommittedOffset(std::string consumerName, std::string topicName) const {
+    EpochGuard guard;
+    Topic* topic = findTopic(topicName);
+    if (!topic || !topic->getLog()) return NO_OFFSET;
+
+    return topic->getLog()->getCommitted(consumerName);
+}
+
+// Takes ownership of the publisher's reference to each message
+void PubSubSystem::route(Topic* topic, Message* const* messages, std::size_t count) {
+    topic->assignExpiry(messages, count);
+    if (topic->getLog()) {
+        topic->getLog()->append(messages, count); // assigns offsets before anyone can read them
+    }
+    if (dispatcher) {
+        dispatcher->dispatch(topic, messages, count);
+        return;
+    }
+    deliver(topic, messages, count);
+    for (std::size_t i = 0; i < count; i++) {
+        messages[i]->release(); // subscribers hold their own references
+    }
+}
+
+void PubSubSystem::deliver(Topic* topic, Message* const* messages, std::size_t count) {
+    EpochGuard guard; // matched subscribers stay alive until fan-out is done
+    std::vector<Subscription> matched;
+    patternSubscriptions.match(topic->getName(), matched);
+    if (count == 1) {
+        topic->publishMessage(messages[0], matched);
+    }
+    else {
+        topic->publishBatch(messages, count, matched);
     }
-    return nullptr;
+}
+
+Topic* PubSubSystem::findTopic(std::string topicName) const {
+    const TopicRegistry* registry = topics.load(std::memory_order_acquire);
+    auto it = registry->byName.find(topicName);
+    return it != registry->byName.end() ? it->second : nullptr;
 }
 
 Subcriber* PubSubSystem::findSubcriber(std::string subcriberId) const {
-    for (auto it = subcribers_map.begin(); it != subcribers_map.end(); it++) {
-        if (it->first == subcriberId) {
-            return it->second;
-        }
+    auto it = subcribers_map.find(subcriberId);
+    return it != subcribers_map.end() ? it->second : nullptr;
+}
+
+Topic* PubSubSystem::findTopic(TopicId topicId) const {
+    const TopicRegistry* registry = topics.load(std::memory_order_acquire);
+    return topicId.value < registry->byId.size() ? registry->byId[topicId.value] : nullptr;
+}
+
+Subcriber* PubSubSystem::findSubcriber(SubscriberId subcriberId) const {
+    return subcriberId.value < subcribersById.size() ? subcribersById[subcriberId.value] : nullptr;
+}
+
+#ifndef PUBSUBSYSTEM_NO_MAIN // defined when linking the benchmark
+ConsumerTask printNews(Subcriber* subcriber, std::size_t count, std::atomic<bool>& done) {
+    for (std::size_t i = 0; i < count; i++) {
+        MessagePtr message = co_await subcriber->next();
+        if (!message) break;
+        std::cout << subcriber->getName() << " awaited: " << message->getContent() << std::endl;
     }
-    return nullptr;
+    done = true;
 }
 
 int main() {
-    PubSubSystem pubSubSystem;
+    CoroutineExecutor executor(1); // declared first so it outlives every subscriber
+    PubSubSystem pubSubSystem(2); // deliver on two dispatcher threads
 
     // Create new topics
     Topic* topic1 = pubSubSystem.createTopic("Topic 1", "Description 1");
@@ -165,5 +1910,97 @@ int main() {
     pubSubSystem.publish("Topic 1", "New AI released today");
     pubSubSystem.publish("Topic 2", "Threads definition");
 
+    // Hot paths resolve names once and publish through handles
+    TopicId topic3Id = pubSubSystem.getTopicId("Topic 3");
+    pubSubSystem.subscribe(sub3->getHandle(), topic3Id);
+    pubSubSystem.publish(topic3Id, "Published by handle");
+
+    // Publish a burst to one topic and a mixed burst across topics; the dispatcher
+    // keeps order within each topic, so Mixed 2 may arrive before or after Mixed 3
+    std::vector<std::string> burst = {"Order 1", "Order 2", "Order 3"};
+    pubSubSystem.publishBatch("Topic 3", burst);
+    std::vector<std::pair<std::string, std::string>> mixed = {
+        {"Topic 1", "Mixed 1"}, {"Topic 2", "Mixed 2"}, {"Topic 1", "Mixed 3"}
+    };
+    pubSubSystem.publishBatch(mixed);
+
+    // Wildcard subscriptions: sub3 gets every order, sub1 matches EU orders twice
+    pubSubSystem.createTopic("orders/eu/de", "German orders");
+    pubSubSystem.createTopic("orders/us/ny", "New York orders");
+    pubSubSystem.subscribe(sub3->getId(), "orders/#");
+    pubSubSystem.subscribe(sub1->getId(), "orders/eu/*");
+    pubSubSystem.subscribe(sub1->getId(), "orders/#"); // still delivered once
+    pubSubSystem.publish("orders/eu/de", "Order from Berlin");
+    pubSubSystem.publish("orders/us/ny", "Order from Brooklyn");
+
+    // Persist a topic, then replay it to a late subscriber from its committed offset
+    pubSubSystem.enablePersistence("pubsub_logs");
+    Subcriber* auditor = pubSubSystem.addSubcriber("auditor");
+    pubSubSystem.publish("Topic 2", "Persisted 1");
+    pubSubSystem.publish("Topic 2", "Persisted 2");
+    std::uint64_t from = pubSubSystem.getCommittedOffset("auditor", "Topic 2");
+    std::size_t replayed = pubSubSystem.replay(auditor->getId(), "Topic 2", from);
+    pubSubSystem.commitOffset("auditor", "Topic 2", from + replayed);
+    std::cout << auditor->getName() << " replayed " << replayed << " messages from offset " << from << std::endl;
+
+    // Two workers split a partitioned topic; when one goes idle the other takes over
+    pubSubSystem.createTopic("jobs", "Work items", 4);
+    Subcriber* worker1 = pubSubSystem.addSubcriber("worker1");
+    Subcriber* worker2 = pubSubSystem.addSubcriber("worker2");
+    pubSubSystem.joinGroup(worker1->getId(), "jobs", "workers");
+    pubSubSystem.joinGroup(worker2->getId(), "jobs", "workers");
+    for (int i = 0; i < 8; i++) {
+        pubSubSystem.publish("jobs", "Job " + std::to_string(i), "customer" + std::to_string(i));
+    }
+    pubSubSystem.flush();
+    worker2->setActive(false);
+    pubSubSystem.publish("jobs", "Job 8", "customer8");
+    pubSubSystem.flush();
+    std::cout << worker1->getName() << " has " << worker1->getPendingCount() << " jobs, "
+        << worker2->getName() << " has " << worker2->getPendingCount() << " jobs" << std::endl;
+
+    // Filtered subscriptions only queue the messages they care about
+    pubSubSystem.createTopic("alerts", "System alerts");
+    Subcriber* pager = pubSubSystem.addSubcriber("pager");
+    pubSubSystem.subscribe(pager->getId(), "alerts", FilterSpec{FilterType::HEADER_EQUALS, "severity", "critical"});
+    pubSubSystem.publish("alerts", "Disk 80% full", Headers{{"severity", "warning"}});
+    pubSubSystem.publish("alerts", "Database down", Headers{{"severity", "critical"}});
+    pubSubSystem.flush();
+    std::cout << pager->getName() << " has " << pager->getPendingCount() << " alert" << std::endl;
+
+    // Stale quotes expire out of an idle subscriber's mailbox
+    pubSubSystem.createTopic("quotes", "Price quotes");
+    pubSubSystem.setTopicTtl("quotes", std::chrono::milliseconds(20));
+    Subcriber* idle = pubSubSystem.addSubcriber("idle");
+    pubSubSystem.subscribe(idle->getId(), "quotes");
+    pubSubSystem.publish("quotes", "ACME 101.5");
+    pubSubSystem.publishWithTtl("quotes", "ACME 101.7", std::chrono::milliseconds(500));
+    pubSubSystem.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pubSubSystem.expireMessages();
+    std::cout << idle->getName() << " expired " << idle->getExpiredCount() << ", still holds "
+        << idle->getPendingCount() << std::endl;
+
+    // A coroutine consumer suspends until each delivery instead of polling
+    pubSubSystem.createTopic("news", "Headlines");
+    Subcriber* reader = pubSubSystem.addSubcriber("reader");
+    pubSubSystem.subscribe(reader->getId(), "news");
+    std::atomic<bool> newsDone(false);
+    executor.spawn(printNews(reader, 2, newsDone));
+    pubSubSystem.publish("news", "Coroutines land in C++20");
+    pubSubSystem.publish("news", "Executor resumes consumers");
+    while (!newsDone) {
+        std::this_thread::yield();
+    }
+
+    // Wait for the dispatcher, then drain sub1's mailbox without blocking
+    pubSubSystem.flush();
+    std::vector<MessagePtr> received;
+    sub1->drainMessages(received);
+    for (const MessagePtr& message : received) {
+        std::cout << sub1->getName() << " read: " << message->getContent() << std::endl;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
+#endif
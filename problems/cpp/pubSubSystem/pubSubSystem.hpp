@@ -2,85 +2,734 @@
 #define PUBSUBSYSTEM_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <span>
+#include <utility>
 #include <ctime>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <optional>
+#include <chrono>
+#include <climits>
+#include <coroutine>
+#include <exception>
 #include <unordered_map>
 
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+constexpr std::size_t DEFAULT_MAILBOX_CAPACITY = 1024;
+constexpr std::size_t DEFAULT_SEGMENT_BYTES = 64 * 1024 * 1024;
+constexpr std::uint64_t NO_OFFSET = UINT64_MAX;
+constexpr std::uint32_t INVALID_HANDLE = UINT32_MAX;
+constexpr std::size_t EPOCH_SLOT_BLOCK_SIZE = 256; // reader slots allocated together, one per thread
+constexpr std::size_t DEFAULT_DISPATCH_QUEUE_CAPACITY = 4096; // queued publishes per dispatcher shard
+
+enum class OverflowPolicy {
+    BLOCK,
+    DROP_OLDEST,
+    DROP_NEWEST
+};
+
+struct LogConfig {
+    std::size_t segmentBytes = DEFAULT_SEGMENT_BYTES;
+    std::size_t maxSegments = 0; // 0 keeps every segment
+    std::time_t maxAgeSeconds = 0; // 0 keeps segments regardless of age
+};
+
+class TopicLog;
+class Subcriber;
+class ConsumerGroup;
+
+// Dense indexes handed out by PubSubSystem; the handle API skips string hashing
+struct TopicId {
+    std::uint32_t value = INVALID_HANDLE;
+
+    bool isValid() const { return value != INVALID_HANDLE; }
+    bool operator==(const TopicId& other) const = default;
+};
+
+struct SubscriberId {
+    std::uint32_t value = INVALID_HANDLE;
+
+    bool isValid() const { return value != INVALID_HANDLE; }
+    bool operator==(const SubscriberId& other) const = default;
+};
+
+std::int64_t steadyNowMillis(); // clock used for message expiry
+
+using Headers = std::vector<std::pair<std::string, std::string>>;
+
+enum class FilterType {
+    PREFIX,
+    SUBSTRING,
+    HEADER_EQUALS
+};
+
+struct FilterSpec {
+    FilterType type;
+    std::string pattern; // content prefix, content substring or header name
+    std::string value; // expected header value for HEADER_EQUALS
+};
+
+// Immutable, intrusively reference-counted payload shared by every subscriber
 class Message {
 private:
+    // Header of a contiguous allocation holding a whole batch of messages
+    struct Block {
+        std::atomic<std::size_t> liveCount;
+    };
+
     std::string topic;
     std::string content;
+    Headers headers;
     std::time_t timestamp;
+    std::uint64_t offset; // position in the topic log, NO_OFFSET when not persisted
+    std::int64_t expiresAt; // steadyNowMillis() deadline, 0 never expires
+    std::uint32_t partition;
+    mutable std::atomic<int> refCount;
+    Block* block; // nullptr when allocated on its own
+
+    friend class TopicLog;
+    friend class Topic;
+
+    Message(std::string topic, std::string content, Block* block);
+    ~Message() = default; // destroyed by the last release()
+
+    template <typename Content>
+    static Message* createBlock(const std::string& topic, std::span<const Content> contents);
+
+public:
+    Message(std::string topic, std::string content); // refCount starts at 1
+    Message(std::string topic, std::string content, Headers headers);
+    Message(std::string topic, std::string content, std::time_t timestamp, std::uint64_t offset);
+    Message(const Message&) = delete;
+    Message& operator=(const Message&) = delete;
+
+    std::string_view getTopic() const;
+    std::string_view getContent() const;
+    const Headers& getHeaders() const;
+    std::optional<std::string_view> getHeader(std::string_view name) const;
+    std::time_t getTimestamp() const;
+    std::uint64_t getOffset() const;
+    std::uint32_t getPartition() const;
+    std::int64_t getExpiresAt() const;
+    bool isExpired(std::int64_t nowMillis) const;
+
+    void retain() const;
+    void release() const;
+
+    // Allocates one message per content in a single block, each with refCount 1
+    static Message* createBatch(const std::string& topic, std::span<const std::string> contents);
+    static Message* createBatch(const std::string& topic, std::span<const std::string_view> contents);
+};
+
+// RAII handle owning one reference to a Message
+class MessagePtr {
+private:
+    const Message* message;
 
 public:
-    Message(std::string topic, std::string content);
+    MessagePtr();
+    explicit MessagePtr(const Message* message); // adopts an existing reference
+    MessagePtr(const MessagePtr& other);
+    MessagePtr(MessagePtr&& other) noexcept;
+    MessagePtr& operator=(MessagePtr other) noexcept;
+    ~MessagePtr();
 
-    std::string getTopic() const;
-    std::string getContent() const;
+    const Message* get() const;
+    const Message* operator->() const;
+    const Message& operator*() const;
+    explicit operator bool() const;
 };
 
 
+// Bounded lock-free MPMC ring buffer (Vyukov), capacity rounded up to a power of two.
+// Expired messages anywhere in the ring can be released in place; their cells stay
+// queued as empty slots that consumers skip.
+class Mailbox {
+private:
+    static constexpr std::size_t PURGING = SIZE_MAX; // sequence of a cell held by purgeCell
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        std::atomic<std::int64_t> deadline; // copy of the message's expiry, readable without owning it
+        std::atomic<Message*> message; // nullptr once purged in place
+    };
+
+    Cell* buffer;
+    std::size_t mask;
+    OverflowPolicy policy;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> enqueuePos;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> dequeuePos;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> droppedCount;
+    std::atomic<std::size_t> expiredCount;
+    std::atomic<std::size_t> purgedCells; // purged in place and not popped yet
+
+    bool tryPush(Message* message, std::size_t& pos);
+    std::size_t tryPushBatch(Message* const* messages, std::size_t count, std::size_t& first);
+    bool popCell(Message*& message); // claims the head cell; message is nullptr if it was purged
+    void releaseCell(Cell* cell, std::size_t pos);
+    void skipPurgedHead();
+
+public:
+    Mailbox(std::size_t capacity, OverflowPolicy policy);
+    ~Mailbox();
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    std::size_t getCapacity() const;
+    std::size_t getSize() const; // live messages; purged cells are not counted
+    bool isEmpty() const; // no cell queued, purged ones included
+    std::size_t getDroppedCount() const;
+    std::size_t getExpiredCount() const;
+    OverflowPolicy getPolicy() const;
+
+    // Take ownership of one reference per message. Positions identify the accepted
+    // messages for purgeCell; pushBatch accepts a prefix and returns its length.
+    bool push(Message* message, std::size_t* position = nullptr);
+    std::size_t pushBatch(Message* const* messages, std::size_t count, std::size_t* positions = nullptr);
+    bool tryPop(Message*& message);
+    std::size_t drain(std::vector<Message*>& out, std::size_t maxMessages);
+
+    // Releases the message pushed at position if it is still queued and expired. A
+    // live one due later sets laterDeadline to its deadline, otherwise it is 0.
+    bool purgeCell(std::size_t position, std::int64_t nowMillis, std::int64_t& laterDeadline);
+    void countExpired(std::size_t count);
+};
+
+// Hierarchical timing wheel with one entry per message that can expire. Scheduling
+// and firing are O(1) apart from cascading, which moves each entry at most once per level.
+class TimingWheel {
+public:
+    // A message waiting in a subscriber's mailbox at position
+    struct Expiry {
+        Subcriber* subcriber;
+        std::size_t position;
+        std::int64_t deadlineMillis;
+    };
+
+private:
+    static constexpr std::size_t LEVELS = 4;
+    static constexpr std::size_t SLOT_BITS = 6;
+    static constexpr std::size_t SLOTS = 1 << SLOT_BITS;
+
+    struct Entry {
+        std::int64_t deadlineTick;
+        Subcriber* subcriber;
+        std::size_t position;
+    };
+
+    std::vector<Entry> slots[LEVELS][SLOTS];
+    std::int64_t tickMillis;
+    std::int64_t currentTick;
+    std::size_t entryCount;
+    std::mutex mtx;
+
+    void insertLocked(Entry entry);
+
+public:
+    TimingWheel(std::int64_t tickMillis, std::int64_t startMillis);
+
+    void schedule(std::span<const Expiry> expiries);
+    void cancel(Subcriber* subcriber);
+    std::size_t advance(std::int64_t nowMillis, std::vector<std::pair<Subcriber*, std::size_t>>& due);
+};
+
+class CoroutineExecutor;
+
+// Fire-and-forget consumer coroutine, started by CoroutineExecutor::spawn
+class ConsumerTask {
+public:
+    struct promise_type {
+        CoroutineExecutor* executor = nullptr; // resumes the coroutine after each co_await
+
+        ConsumerTask get_return_object() {
+            return ConsumerTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit ConsumerTask(std::coroutine_handle<promise_type> handle);
+
+public:
+    ConsumerTask(ConsumerTask&& other) noexcept;
+    ConsumerTask& operator=(ConsumerTask&&) = delete;
+    ~ConsumerTask(); // destroys the coroutine if it was never spawned
+
+    std::coroutine_handle<promise_type> release();
+};
+
+// Small thread pool resuming consumer coroutines. It must outlive the
+// PubSubSystem whose subscribers its coroutines await.
+class CoroutineExecutor {
+private:
+    std::mutex mtx;
+    std::condition_variable readyCond;
+    std::deque<std::coroutine_handle<>> ready;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+    void run();
+
+public:
+    explicit CoroutineExecutor(std::size_t numThreads = 1);
+    ~CoroutineExecutor(); // resumes everything already queued, then joins
+    CoroutineExecutor(const CoroutineExecutor&) = delete;
+    CoroutineExecutor& operator=(const CoroutineExecutor&) = delete;
+
+    void post(std::coroutine_handle<> handle);
+    void spawn(ConsumerTask task);
+};
+
 class Subcriber {
 private:
+    // Coroutine suspended in next(); a delivery hands it the message and reschedules it
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        CoroutineExecutor* executor = nullptr;
+        Message* message = nullptr;
+    };
+
     std::string subcriberId;
+    SubscriberId handle;
     std::string name;
-    std::vector<Message*> messageQueue;
-    bool active;
+    Mailbox mailbox;
+    std::atomic<bool> active;
+    TimingWheel* expiryWheel;
+    std::atomic<Waiter*> waiter; // nullptr unless a consumer coroutine is parked
+    std::atomic<bool> closed;
+    std::vector<ConsumerGroup*> groups; // rebalanced when activity changes
+    std::mutex groupMutex; // guards groups; taken before any ConsumerGroup mutex
+
+    void scheduleExpiry(Message* const* messages, const std::size_t* positions, std::size_t count);
+    bool popLive(Message*& message); // skips expired messages
+    bool park(Waiter* parked); // false if a message or close arrived before parking
+    void wake();
+
+    friend class ConsumerGroup;
 
 public:
-    Subcriber(std::string subcriberId, std::string name);
+    Subcriber(std::string subcriberId, std::string name,
+        std::size_t mailboxCapacity = DEFAULT_MAILBOX_CAPACITY,
+        OverflowPolicy policy = OverflowPolicy::DROP_OLDEST, SubscriberId handle = {});
 
-    std::string getId() const;
+    const std::string& getId() const;
+    SubscriberId getHandle() const;
     std::string getName() const;
     bool isActive() const;
-    const std::vector<Message*>& getMessageQueue() const;
-    
-    void receiveMessage(Message* message);
+    std::size_t getPendingCount() const;
+    std::size_t getDroppedCount() const;
+    std::size_t getExpiredCount() const;
+
+    bool receiveMessage(Message* message);
+    std::size_t receiveBatch(Message* const* messages, std::size_t count);
+    std::size_t drainMessages(std::vector<MessagePtr>& out, std::size_t maxMessages = SIZE_MAX);
     void clearMessage();
     void setActive(bool status);
+    void setExpiryWheel(TimingWheel* wheel);
+    bool expireMessage(std::size_t position, std::int64_t nowMillis); // fired by the wheel
+
+    class MessageAwaiter {
+    private:
+        Subcriber* subcriber;
+        Waiter waiter;
+
+    public:
+        explicit MessageAwaiter(Subcriber* subcriber);
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<ConsumerTask::promise_type> handle);
+        MessagePtr await_resume();
+    };
+
+    // co_await inside a ConsumerTask; one consumer per subscriber. Yields an empty
+    // MessagePtr once the subscriber is closed, after which it must not be touched.
+    MessageAwaiter next();
+    void close(); // also done by removeSubcriber
+};
+
+// Predicate compiled once from a FilterSpec and shared by every subscription using it
+class ContentFilter {
+private:
+    FilterSpec spec;
+    std::boyer_moore_horspool_searcher<const char*> searcher; // used by SUBSTRING
+
+public:
+    explicit ContentFilter(FilterSpec spec);
+    ContentFilter(const ContentFilter&) = delete;
+    ContentFilter& operator=(const ContentFilter&) = delete;
+
+    const FilterSpec& getSpec() const;
+    bool matches(const Message& message) const;
+
+    static std::string canonicalKey(const FilterSpec& spec);
+};
+
+struct Subscription {
+    Subcriber* subcriber;
+    std::shared_ptr<const ContentFilter> filter; // nullptr accepts every message
+};
+
+// Members of a group split a topic's partitions so each message reaches one member.
+// Partitions are reassigned whenever membership or member activity changes.
+class ConsumerGroup {
+private:
+    std::string name;
+    std::size_t partitionCount;
+    std::vector<Subcriber*> members; // guarded by mtx
+    // Immutable owner per partition, nullptr when no member is active; publishers read
+    // it without locking and writers swap in a new table
+    std::atomic<const std::vector<Subcriber*>*> owners;
+    mutable std::mutex mtx;
+
+    void rebalanceLocked();
+
+public:
+    ConsumerGroup(std::string name, std::size_t partitionCount);
+    ~ConsumerGroup();
+    ConsumerGroup(const ConsumerGroup&) = delete;
+    ConsumerGroup& operator=(const ConsumerGroup&) = delete;
+
+    std::string getName() const;
+    std::vector<Subcriber*> getMembers() const;
+    std::vector<std::size_t> getAssignment(Subcriber* subcriber);
+
+    bool addMember(Subcriber* subcriber);
+    bool removeMember(Subcriber* subcriber);
+    Subcriber* getOwner(std::size_t partition) const; // call inside an EpochGuard
+    void rebalance();
+};
+
+// Epoch-based reclamation for copy-on-write snapshots. Readers pin the current
+// epoch without locking; a retired snapshot is freed once every reader that
+// could still see it has left its read section.
+class EpochDomain {
+private:
+    struct alignas(CACHE_LINE_SIZE) ReaderSlot {
+        std::atomic<std::uint64_t> epoch{0}; // 0 outside a read section
+        std::atomic<bool> claimed{false};
+    };
+
+    struct ThreadState {
+        ReaderSlot* slot = nullptr;
+        std::size_t depth = 0; // read sections nest
+        ~ThreadState(); // hands the slot to another thread
+    };
+
+    // Threads keep their slot until they exit; once every slot is taken another
+    // block is appended. Blocks live as long as the domain.
+    struct SlotBlock {
+        ReaderSlot slots[EPOCH_SLOT_BLOCK_SIZE];
+        std::atomic<SlotBlock*> next{nullptr};
+    };
+
+    struct Retired {
+        std::uint64_t epoch;
+        void* pointer;
+        void (*destroy)(void*);
+    };
+
+    std::atomic<std::uint64_t> globalEpoch;
+    SlotBlock firstBlock;
+    std::mutex retiredMutex;
+    std::vector<Retired> retired;
+
+    static thread_local ThreadState threadState;
+
+    EpochDomain();
+    ReaderSlot* claimSlot();
+    std::uint64_t oldestPinnedEpoch() const; // UINT64_MAX when no reader is inside
+    void retire(void* pointer, void (*destroy)(void*));
+
+public:
+    ~EpochDomain();
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    static EpochDomain& global();
+
+    void enter();
+    void exit();
+    void synchronize(); // waits for every read section already in progress; never call from inside one
+
+    // Call after the snapshot has been unpublished
+    template <typename T>
+    void retire(const T* pointer) {
+        if (!pointer) return;
+        retire(const_cast<T*>(pointer), [](void* object) { delete static_cast<T*>(object); });
+    }
+};
+
+class EpochGuard {
+public:
+    EpochGuard();
+    ~EpochGuard();
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
 };
 
 class Topic {
 private:
     std::string name;
+    TopicId handle;
     std::string description;
-    std::unordered_map<std::string, Subcriber*> subcribers_map;
-    bool active;
+    // Immutable snapshot read by publishers without locking; writers copy, edit and swap it
+    std::atomic<const std::vector<Subscription>*> subscriptions;
+    std::unordered_map<Subcriber*, std::size_t> subscriptionIndex; // guarded by subscriptionMutex
+    std::mutex subscriptionMutex; // serializes writers only
+    std::atomic<bool> active;
+    std::unique_ptr<TopicLog> log; // nullptr unless persistence is enabled
+    std::size_t partitionCount;
+    std::atomic<std::size_t> nextPartition; // round robin for unkeyed messages
+    std::atomic<std::int64_t> ttlMillis; // 0 keeps messages until drained
+    std::unordered_map<std::string, std::unique_ptr<ConsumerGroup>> groups; // guarded by groupMutex
+    std::atomic<const std::vector<ConsumerGroup*>*> groupList; // snapshot of groups, read like subscriptions
+    mutable std::mutex groupMutex; // groups are never removed, only added
+
+    void replaceSubscriptions(const std::vector<Subscription>* next); // caller holds subscriptionMutex
+    void fanOut(Message* const* messages, std::size_t count, const std::vector<Subscription>& patternSubscriptions);
+    void deliverToGroups(Message* const* messages, std::size_t count);
 
 public:
-    Topic(std::string name, std::string description);
+    Topic(std::string name, std::string description, std::size_t partitionCount = 1, TopicId handle = {});
+    ~Topic();
 
-    std::string getName() const;
+    const std::string& getName() const;
+    TopicId getHandle() const;
     std::string getDescription() const;
     bool isActive() const;
+    std::size_t getPartitionCount() const;
     std::vector<Subcriber*> getSubcribers() const;
-    void addSubscriber(Subcriber* subcriber);
+    ConsumerGroup* getGroup(const std::string& groupName) const;
+    void addSubscriber(Subcriber* subcriber, std::shared_ptr<const ContentFilter> filter = nullptr);
     void removeSubscriber(Subcriber* subsriber);
-    void publishMessage(Message* message);
+    void publishMessage(Message* message, const std::vector<Subscription>& patternSubscriptions = {});
+    void publishBatch(Message* const* messages, std::size_t count,
+        const std::vector<Subscription>& patternSubscriptions = {});
     void setActive(bool status);
+
+    bool openLog(const std::string& rootDirectory, const LogConfig& config);
+    TopicLog* getLog() const;
+
+    void assignPartition(Message* message, std::string_view key); // empty key picks round robin
+    void assignExpiry(Message* const* messages, std::size_t count, std::int64_t ttlMillis = 0);
+    void setTtl(std::chrono::milliseconds ttl);
+    std::chrono::milliseconds getTtl() const;
+    bool joinGroup(const std::string& groupName, Subcriber* subcriber);
+    bool leaveGroup(const std::string& groupName, Subcriber* subcriber);
+    void leaveAllGroups(Subcriber* subcriber);
+};
+
+// Segment trie of subscription patterns split on '/'.
+// "*" matches exactly one segment, "#" (last segment only) matches zero or more.
+class TopicTrie {
+private:
+    struct SegmentHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view segment) const { return std::hash<std::string_view>()(segment); }
+    };
+
+    // Never modified once reachable from root. Copying a node is shallow: the copy
+    // shares every child subtree with the original.
+    struct Node {
+        std::unordered_map<std::string, std::shared_ptr<Node>, SegmentHash, std::equal_to<>> children;
+        std::vector<Subscription> subscriptions;
+    };
+
+    // Copy-on-write like Topic subscriptions, by path copying: a change copies only
+    // the nodes from the root to the pattern, so it costs O(depth), not O(patterns)
+    std::atomic<const Node*> root;
+    std::mutex writeMutex;
+    std::unordered_map<Subcriber*, std::vector<std::string>> patternsBySubcriber; // guarded by writeMutex
+
+    void replaceRoot(const Node* next); // caller holds writeMutex
+
+    static std::vector<std::string_view> splitSegments(std::string_view topicName);
+    // Replaces the nodes on the path below next, itself a fresh copy, with copies; returns them root first
+    static std::vector<Node*> copyPath(Node* next, const std::vector<std::string_view>& segments);
+    static void removeFromCopy(Node* next, std::string_view pattern, Subcriber* subcriber);
+    static void matchNode(const Node* node, const std::vector<std::string_view>& segments,
+        std::size_t depth, std::vector<Subscription>& out);
+
+public:
+    TopicTrie();
+    ~TopicTrie();
+    TopicTrie(const TopicTrie&) = delete;
+    TopicTrie& operator=(const TopicTrie&) = delete;
+
+    static bool isPattern(std::string_view topicName);
+    static bool isValidPattern(std::string_view pattern);
+
+    bool insert(std::string_view pattern, Subcriber* subcriber, std::shared_ptr<const ContentFilter> filter = nullptr);
+    bool remove(std::string_view pattern, Subcriber* subcriber);
+    void removeAll(Subcriber* subcriber); // copies nothing for a subscriber without patterns
+    // May contain duplicates; subscribers stay valid only inside the caller's EpochGuard
+    void match(std::string_view topicName, std::vector<Subscription>& out) const;
+};
+
+// Worker pool delivering publishes off the publisher's thread.
+// Each topic always maps to the same shard, so per-topic order is preserved.
+// Shard queues are bounded: dispatch blocks while the topic's shard is full.
+class Dispatcher {
+public:
+    using DeliverFn = std::function<void(Topic*, Message* const*, std::size_t)>;
+
+private:
+    struct Task {
+        Topic* topic;
+        Message* message; // used when batch is empty
+        std::vector<Message*> batch;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::mutex mtx;
+        std::condition_variable taskCond;
+        std::condition_variable spaceCond;
+        std::condition_variable completedCond;
+        std::deque<Task> tasks;
+        std::uint64_t enqueued = 0; // tasks ever queued
+        std::uint64_t completed = 0; // tasks ever delivered, in queue order
+        bool stopping = false;
+        std::thread worker;
+    };
+
+    DeliverFn deliver;
+    std::size_t queueCapacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    Shard& shardFor(Topic* topic);
+    void run(Shard& shard);
+
+public:
+    Dispatcher(std::size_t numWorkers, DeliverFn deliver,
+        std::size_t queueCapacity = DEFAULT_DISPATCH_QUEUE_CAPACITY);
+    ~Dispatcher(); // delivers everything already queued, then joins
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+
+    std::size_t getWorkerCount() const;
+
+    // Takes ownership of one reference per message
+    void dispatch(Topic* topic, Message* const* messages, std::size_t count);
+    void flush(); // waits until every publish queued before the call has been delivered
 };
 
+// Every member function may be called from any thread, concurrently with any other,
+// except the destructor. Publishing resolves topics through a lock-free snapshot and
+// never waits for registry changes. createTopic, removeTopic and enablePersistence
+// serialize with each other; addSubcriber and removeSubcriber exclude the calls that
+// name a subscriber. removeTopic and removeSubcriber wait for in-flight publishes.
 class PubSubSystem {
 private:
-    std::unordered_map<std::string, Topic*> topics_map;
-    std::unordered_map<std::string, Subcriber*> subcribers_map;
-    int subscriberIdCounter;
+    // Immutable, published like Topic subscriptions; topics found in it stay alive
+    // until the caller's EpochGuard ends
+    struct TopicRegistry {
+        std::unordered_map<std::string, Topic*> byName;
+        std::vector<Topic*> byId; // indexed by TopicId, nullptr once removed
+    };
+
+    std::atomic<const TopicRegistry*> topics;
+    std::mutex topicMutex; // serializes registry writers, persistent, logDirectory and logConfig
+    std::unordered_map<std::string, Subcriber*> subcribers_map; // guarded by subcriberMutex
+    std::vector<Subcriber*> subcribersById; // indexed by SubscriberId, nullptr once removed
+    mutable std::shared_mutex subcriberMutex; // exclusive to add or remove; never taken when publishing
+    TopicTrie patternSubscriptions;
+    std::unordered_map<std::string, std::weak_ptr<const ContentFilter>> filters; // by canonical key
+    std::mutex filterMutex;
+    int subscriberIdCounter; // guarded by subcriberMutex
+    std::unique_ptr<Dispatcher> dispatcher; // nullptr delivers on the publisher's thread
+    bool persistent;
+    std::string logDirectory;
+    LogConfig logConfig;
+    TimingWheel expiryWheel;
+    std::mutex expiryMutex; // keeps subscribers alive while the wheel fires
+    std::thread expiryThread;
+    std::mutex expiryThreadMutex;
+    std::condition_variable expiryCond;
+    bool expiryStopping;
 
 public:
-    PubSubSystem();
-    //~PubSubSystem();
+    explicit PubSubSystem(std::size_t dispatcherThreads = 0);
+    ~PubSubSystem();
 
-    Topic* createTopic(std::string name, std::string description);
+    Topic* createTopic(std::string name, std::string description, std::size_t partitionCount = 1);
     void removeTopic(std::string name);
 
-    Subcriber* addSubcriber(std::string name);
-    bool subscribe(std::string subcriberId, std::string topicName);
+    Subcriber* addSubcriber(std::string name,
+        std::size_t mailboxCapacity = DEFAULT_MAILBOX_CAPACITY,
+        OverflowPolicy policy = OverflowPolicy::DROP_OLDEST);
+    bool removeSubcriber(std::string subcriberId);
+    bool subscribe(std::string subcriberId, std::string topicName); // topicName may be a pattern
+    bool subscribe(std::string subcriberId, std::string topicName, FilterSpec filter);
+    bool unsubscribe(std::string subcriberId, std::string topicName);
+    bool joinGroup(std::string subcriberId, std::string topicName, std::string groupName);
+    bool leaveGroup(std::string subcriberId, std::string topicName, std::string groupName);
     bool publish(std::string topicName, std::string content);
+    bool publish(std::string topicName, std::string content, std::string_view key);
+    bool publish(std::string topicName, std::string content, Headers headers, std::string_view key = {});
+    std::size_t publishBatch(const std::string& topicName, std::span<const std::string> contents);
+    // Each run of consecutive entries for one topic is published as a single batch, in
+    // input order. Dispatcher threads keep that order only within each topic.
+    std::size_t publishBatch(std::span<const std::pair<std::string, std::string>> topicContents);
+
+    // Handle API: resolve names once, then index dense arrays on every call
+    TopicId getTopicId(const std::string& topicName) const;
+    SubscriberId getSubscriberId(const std::string& subcriberId) const;
+    bool subscribe(SubscriberId subcriberId, TopicId topicId);
+    bool subscribe(SubscriberId subcriberId, TopicId topicId, FilterSpec filter);
+    bool unsubscribe(SubscriberId subcriberId, TopicId topicId);
+    bool publish(TopicId topicId, std::string content);
+    bool publish(TopicId topicId, std::string content, std::string_view key);
+    std::size_t publishBatch(TopicId topicId, std::span<const std::string> contents);
+
+    void flush(); // waits for asynchronous deliveries to finish
+
+    bool publishWithTtl(std::string topicName, std::string content, std::chrono::milliseconds ttl);
+    bool setTopicTtl(std::string topicName, std::chrono::milliseconds ttl);
+    std::size_t expireMessages(); // purges every message whose deadline has passed
+    void startExpiry(std::chrono::milliseconds interval); // runs expireMessages() in the background
+
+    // Persists every topic to an append-only log under directory
+    bool enablePersistence(std::string directory, LogConfig config = {});
+    std::size_t replay(std::string subcriberId, std::string topicName,
+        std::uint64_t fromOffset, std::size_t maxMessages = SIZE_MAX);
+    std::size_t replaySince(std::string subcriberId, std::string topicName,
+        std::time_t since, std::size_t maxMessages = SIZE_MAX);
+    // Offsets belong to a durable consumer name, which outlives subscriber ids across restarts
+    bool commitOffset(std::string consumerName, std::string topicName, std::uint64_t offset);
+    std::uint64_t getCommittedOffset(std::string consumerName, std::string topicName) const;
 
 private:
     std::string generateSubcriberId();
+    std::shared_ptr<const ContentFilter> compileFilter(FilterSpec spec);
+    bool addSubscription(const std::string& subcriberId, const std::string& topicName,
+        std::shared_ptr<const ContentFilter> filter);
+    bool publishTo(Topic* topic, std::string content, Headers headers, std::string_view key);
+    std::size_t publishBatchTo(Topic* topic, std::span<const std::string> contents);
+    std::size_t publishBatchTo(Topic* topic, std::span<const std::string_view> contents);
+    std::size_t routeBlock(Topic* topic, Message* block, std::size_t count);
+    void route(Topic* topic, Message* const* messages, std::size_t count);
+    void deliver(Topic* topic, Message* const* messages, std::size_t count);
+    void replaceTopics(const TopicRegistry* next); // caller holds topicMutex
+    // Call inside an EpochGuard
     Topic* findTopic(std::string topicName) const;
+    Topic* findTopic(TopicId topicId) const;
+    // Call holding subcriberMutex
     Subcriber* findSubcriber(std::string subcriberId) const;
+    Subcriber* findSubcriber(SubscriberId subcriberId) const;
 };
 
 #endif
\ No newline at end of file
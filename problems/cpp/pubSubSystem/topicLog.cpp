@@ -0,0 +1,404 @@
+#include "topicLog.hpp"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::uint32_t RECORD_MAGIC = 0x4D4C4F47; // "MLOG"
+constexpr const char* SEGMENT_SUFFIX = ".log";
+constexpr const char* OFFSET_SUFFIX = ".offset";
+
+constexpr std::size_t SEGMENT_NAME_DIGITS = 20;
+
+std::string segmentFileName(std::uint64_t baseOffset) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu", (unsigned long long)baseOffset);
+    return std::string(name) + SEGMENT_SUFFIX;
+}
+
+// Only names written by segmentFileName; anything else in the directory is left alone
+bool parseSegmentName(const std::string& stem, std::uint64_t& baseOffset) {
+    if (stem.size() != SEGMENT_NAME_DIGITS) return false;
+    if (!std::all_of(stem.begin(), stem.end(), [](unsigned char c) { return std::isdigit(c); })) return false;
+    errno = 0;
+    baseOffset = std::strtoull(stem.c_str(), nullptr, 10);
+    return errno == 0;
+}
+
+// Headers follow the content as length-prefixed strings: name, value, name, value...
+std::size_t encodedHeadersSize(const Headers& headers) {
+    std::size_t size = 0;
+    for (const auto& [name, value] : headers) {
+        size += 2 * sizeof(std::uint32_t) + name.size() + value.size();
+    }
+    return size;
+}
+
+char* encodeString(char* out, std::string_view text) {
+    std::uint32_t length = (std::uint32_t)text.size();
+    std::memcpy(out, &length, sizeof(length));
+    std::memcpy(out + sizeof(length), text.data(), text.size());
+    return out + sizeof(length) + text.size();
+}
+
+bool decodeString(const char*& cursor, const char* end, std::string& text) {
+    std::uint32_t length;
+    if ((std::size_t)(end - cursor) < sizeof(length)) return false;
+    std::memcpy(&length, cursor, sizeof(length));
+    cursor += sizeof(length);
+    if ((std::size_t)(end - cursor) < length) return false;
+    text.assign(cursor, length);
+    cursor += length;
+    return true;
+}
+}
+
+TopicLog::TopicLog(std::string topicName, std::string directory, LogConfig config)
+    : topicName(std::move(topicName)), directory(std::move(directory)), config(config), nextOffset(0) {}
+
+TopicLog::~TopicLog() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (Segment& segment : segments) {
+        closeSegment(segment, false);
+    }
+}
+
+std::uint32_t TopicLog::checksum(std::int64_t timestamp, const char* data, std::size_t length) {
+    std::uint32_t hash = 2166136261u; // FNV-1a
+    for (std::size_t i = 0; i < sizeof(timestamp); i++) {
+        hash = (hash ^ (std::uint8_t)(timestamp >> (i * 8))) * 16777619u;
+    }
+    for (std::size_t i = 0; i < length; i++) {
+        hash = (hash ^ (std::uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+std::size_t TopicLog::recordSize(std::size_t length) {
+    return (sizeof(RecordHeader) + length + 7) & ~(std::size_t)7;
+}
+
+std::string TopicLog::escapeName(std::string_view name) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string escaped;
+    for (unsigned char c : name) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.') {
+            escaped += (char)c;
+        }
+        else {
+            escaped += '%';
+            escaped += hex[c >> 4];
+            escaped += hex[c & 0xF];
+        }
+    }
+    return escaped;
+}
+
+bool TopicLog::mapSegment(Segment& segment, std::size_t capacity) {
+    segment.fd = ::open(segment.path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (segment.fd < 0) return false;
+
+    struct stat info;
+    if (fstat(segment.fd, &info) != 0) {
+        ::close(segment.fd);
+        return false;
+    }
+    if (info.st_size == 0 && capacity == 0) {
+        capacity = config.segmentBytes; // created by a run that stopped before its first write
+    }
+    if ((std::size_t)info.st_size < capacity) {
+        if (ftruncate(segment.fd, capacity) != 0) {
+            ::close(segment.fd);
+            return false;
+        }
+    }
+    else {
+        capacity = info.st_size;
+    }
+
+    void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+    if (data == MAP_FAILED) {
+        ::close(segment.fd);
+        return false;
+    }
+    segment.data = static_cast<char*>(data);
+    segment.capacity = capacity;
+    segment.writePos = 0;
+    segment.firstTimestamp = 0;
+    segment.lastTimestamp = 0;
+    return true;
+}
+
+// Indexes every intact record and stops at the first torn or corrupt one
+bool TopicLog::recoverSegment(Segment& segment) {
+    std::size_t pos = 0;
+    while (pos + sizeof(RecordHeader) <= segment.capacity) {
+        RecordHeader header;
+        std::memcpy(&header, segment.data + pos, sizeof(header));
+        if (header.magic != RECORD_MAGIC) break;
+        std::size_t payload = (std::size_t)header.length + header.headerBytes;
+        if (pos + recordSize(payload) > segment.capacity) break;
+
+        const char* content = segment.data + pos + sizeof(RecordHeader);
+        if (header.checksum != checksum(header.timestamp, content, payload)) break;
+
+        if (segment.positions.empty()) segment.firstTimestamp = header.timestamp;
+        segment.lastTimestamp = header.timestamp;
+        segment.positions.push_back((std::uint32_t)pos);
+        pos += recordSize(payload);
+    }
+    segment.writePos = pos;
+    return true;
+}
+
+bool TopicLog::open() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Failed to create log directory " << directory << std::endl;
+        return false;
+    }
+
+    std::vector<std::uint64_t> baseOffsets;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        std::uint64_t baseOffset;
+        if (entry.path().extension() != SEGMENT_SUFFIX || !entry.is_regular_file()
+            || !parseSegmentName(entry.path().stem().string(), baseOffset)) continue;
+        baseOffsets.push_back(baseOffset);
+    }
+    std::sort(baseOffsets.begin(), baseOffsets.end());
+
+    for (std::uint64_t baseOffset : baseOffsets) {
+        Segment segment;
+        segment.baseOffset = baseOffset;
+        segment.path = (fs::path(directory) / segmentFileName(baseOffset)).string();
+        if (!mapSegment(segment, 0) || !recoverSegment(segment)) {
+            std::cerr << "Failed to recover log segment " << segment.path << std::endl;
+            return false;
+        }
+        segments.push_back(std::move(segment));
+    }
+
+    if (segments.empty()) {
+        if (!rollSegment(0)) return false;
+    }
+    else {
+        Segment& last = segments.back();
+        std::memset(last.data + last.writePos, 0, last.capacity - last.writePos); // drop any torn tail
+        nextOffset = last.baseOffset + last.positions.size();
+    }
+    loadCommittedOffsets();
+    return true;
+}
+
+bool TopicLog::rollSegment(std::size_t minCapacity) {
+    if (!segments.empty()) {
+        Segment& last = segments.back();
+        if (last.positions.empty()) {
+            closeSegment(last, true); // reuse its base offset
+            segments.pop_back();
+        }
+        else {
+            msync(last.data, last.capacity, MS_ASYNC);
+        }
+    }
+
+    Segment segment;
+    segment.baseOffset = nextOffset;
+    segment.path = (fs::path(directory) / segmentFileName(nextOffset)).string();
+    if (!mapSegment(segment, std::max(config.segmentBytes, minCapacity))) {
+        std::cerr << "Failed to create log segment " << segment.path << std::endl;
+        return false;
+    }
+    segments.push_back(std::move(segment));
+    applyRetentionLocked(std::time(nullptr));
+    return true;
+}
+
+void TopicLog::closeSegment(Segment& segment, bool remove) {
+    if (segment.data) {
+        msync(segment.data, segment.capacity, MS_ASYNC);
+        munmap(segment.data, segment.capacity);
+        segment.data = nullptr;
+    }
+    if (segment.fd >= 0) {
+        ::close(segment.fd);
+        segment.fd = -1;
+    }
+    if (remove) {
+        std::remove(segment.path.c_str());
+    }
+}
+
+void TopicLog::applyRetentionLocked(std::time_t now) {
+    // The active segment is never deleted
+    while (segments.size() > 1) {
+        Segment& oldest = segments.front();
+        bool tooMany = config.maxSegments > 0 && segments.size() > config.maxSegments;
+        bool tooOld = config.maxAgeSeconds > 0 && oldest.lastTimestamp < now - config.maxAgeSeconds;
+        if (!tooMany && !tooOld) break;
+
+        closeSegment(oldest, true);
+        segments.erase(segments.begin());
+    }
+}
+
+void TopicLog::applyRetention() {
+    std::lock_guard<std::mutex> lock(mtx);
+    applyRetentionLocked(std::time(nullptr));
+}
+
+void TopicLog::sync() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (Segment& segment : segments) {
+        msync(segment.data, segment.capacity, MS_SYNC);
+    }
+}
+
+std::uint64_t TopicLog::getStartOffset() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return segments.empty() ? nextOffset : segments.front().baseOffset;
+}
+
+std::uint64_t TopicLog::getNextOffset() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nextOffset;
+}
+
+std::size_t TopicLog::getSegmentCount() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return segments.size();
+}
+
+std::uint64_t TopicLog::appendLocked(const Message& message) {
+    std::string_view content = message.getContent();
+    std::time_t timestamp = message.getTimestamp();
+    std::size_t headerBytes = encodedHeadersSize(message.getHeaders());
+    std::size_t size = recordSize(content.size() + headerBytes);
+    if (segments.empty() || segments.back().writePos + size > segments.back().capacity) {
+        if (!rollSegment(size)) return NO_OFFSET;
+    }
+
+    Segment& segment = segments.back();
+    char* record = segment.data + segment.writePos;
+    char* payload = record + sizeof(RecordHeader);
+    std::memcpy(payload, content.data(), content.size());
+    char* out = payload + content.size();
+    for (const auto& [name, value] : message.getHeaders()) {
+        out = encodeString(out, name);
+        out = encodeString(out, value);
+    }
+    RecordHeader header{RECORD_MAGIC, (std::uint32_t)content.size(), (std::int64_t)timestamp,
+        checksum(timestamp, payload, content.size() + headerBytes), (std::uint32_t)headerBytes};
+    std::memcpy(record, &header, sizeof(header));
+
+    if (segment.positions.empty()) segment.firstTimestamp = timestamp;
+    segment.lastTimestamp = timestamp;
+    segment.positions.push_back((std::uint32_t)segment.writePos);
+    segment.writePos += size;
+    return nextOffset++;
+}
+
+void TopicLog::append(Message* const* messages, std::size_t count) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (std::size_t i = 0; i < count; i++) {
+        messages[i]->offset = appendLocked(*messages[i]);
+    }
+}
+
+std::size_t TopicLog::read(std::uint64_t offset, std::size_t maxMessages, std::vector<Message*>& out) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::upper_bound(segments.begin(), segments.end(), offset,
+        [](std::uint64_t value, const Segment& segment) { return value < segment.baseOffset; });
+    if (it != segments.begin()) it--;
+
+    std::size_t count = 0;
+    for (; it != segments.end() && count < maxMessages; it++) {
+        std::uint64_t index = offset > it->baseOffset ? offset - it->baseOffset : 0;
+        for (; index < it->positions.size() && count < maxMessages; index++) {
+            const char* record = it->data + it->positions[index];
+            RecordHeader header;
+            std::memcpy(&header, record, sizeof(header));
+            const char* content = record + sizeof(RecordHeader);
+            Message* message = new Message(topicName, std::string(content, header.length),
+                (std::time_t)header.timestamp, it->baseOffset + index);
+
+            const char* cursor = content + header.length;
+            const char* end = cursor + header.headerBytes;
+            std::string name, value;
+            while (decodeString(cursor, end, name) && decodeString(cursor, end, value)) {
+                message->headers.emplace_back(std::move(name), std::move(value));
+            }
+            out.push_back(message);
+            count++;
+        }
+    }
+    return count;
+}
+
+std::uint64_t TopicLog::findOffset(std::time_t timestamp) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const Segment& segment : segments) {
+        if (segment.positions.empty() || segment.lastTimestamp < timestamp) continue;
+
+        auto it = std::lower_bound(segment.positions.begin(), segment.positions.end(), timestamp,
+            [&segment](std::uint32_t pos, std::time_t value) {
+                RecordHeader header;
+                std::memcpy(&header, segment.data + pos, sizeof(header));
+                return (std::time_t)header.timestamp < value;
+            });
+        return segment.baseOffset + (it - segment.positions.begin());
+    }
+    return nextOffset;
+}
+
+void TopicLog::loadCommittedOffsets() {
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (entry.path().extension() != OFFSET_SUFFIX) continue;
+
+        std::ifstream file(entry.path());
+        std::uint64_t offset;
+        if (file >> offset) {
+            committedOffsets[entry.path().stem().string()] = offset;
+        }
+    }
+}
+
+// Written to a temporary file and renamed so a crash never leaves a partial offset
+bool TopicLog::commit(const std::string& consumerName, std::uint64_t offset) {
+    if (consumerName.empty()) return false;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    fs::path target = fs::path(directory) / (escapeName(consumerName) + OFFSET_SUFFIX);
+    fs::path temp = target;
+    temp += ".tmp";
+    {
+        std::ofstream file(temp, std::ios::trunc);
+        if (!(file << offset << "\n")) return false;
+    }
+    std::error_code error;
+    fs::rename(temp, target, error);
+    if (error) return false;
+
+    committedOffsets[escapeName(consumerName)] = offset;
+    return true;
+}
+
+std::uint64_t TopicLog::getCommitted(const std::string& consumerName) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = committedOffsets.find(escapeName(consumerName));
+    if (it != committedOffsets.end()) return it->second;
+    return segments.empty() ? nextOffset : segments.front().baseOffset;
+}
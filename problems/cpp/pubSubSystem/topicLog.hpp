@@ -0,0 +1,84 @@
+#ifndef TOPICLOG_HPP
+#define TOPICLOG_HPP
+
+#include "pubSubSystem.hpp"
+#include <string>
+#include <vector>
+#include <ctime>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// Append-only log of one topic, stored as memory-mapped segment files named
+// after the offset of their first record. Offsets are message sequence numbers.
+// Committed offsets are keyed by a consumer name the caller keeps stable across
+// restarts; subscriber ids are handed out in creation order and are not.
+class TopicLog {
+private:
+    struct RecordHeader {
+        std::uint32_t magic;
+        std::uint32_t length;
+        std::int64_t timestamp;
+        std::uint32_t checksum; // covers the timestamp, content and encoded headers
+        std::uint32_t headerBytes; // encoded message headers stored after the content
+    };
+
+    struct Segment {
+        std::uint64_t baseOffset = 0;
+        std::string path;
+        int fd = -1;
+        char* data = nullptr;
+        std::size_t capacity = 0;
+        std::size_t writePos = 0;
+        std::vector<std::uint32_t> positions; // byte position of each record
+        std::time_t firstTimestamp = 0;
+        std::time_t lastTimestamp = 0;
+    };
+
+    std::string topicName;
+    std::string directory;
+    LogConfig config;
+    std::vector<Segment> segments;
+    std::uint64_t nextOffset;
+    std::unordered_map<std::string, std::uint64_t> committedOffsets;
+    mutable std::mutex mtx;
+
+    static std::uint32_t checksum(std::int64_t timestamp, const char* data, std::size_t length);
+    static std::size_t recordSize(std::size_t length);
+
+    bool mapSegment(Segment& segment, std::size_t capacity);
+    bool recoverSegment(Segment& segment);
+    bool rollSegment(std::size_t minCapacity);
+    void closeSegment(Segment& segment, bool remove);
+    void applyRetentionLocked(std::time_t now);
+    void loadCommittedOffsets();
+    std::uint64_t appendLocked(const Message& message);
+
+public:
+    TopicLog(std::string topicName, std::string directory, LogConfig config);
+    ~TopicLog();
+    TopicLog(const TopicLog&) = delete;
+    TopicLog& operator=(const TopicLog&) = delete;
+
+    bool open(); // creates the directory or recovers existing segments
+
+    std::uint64_t getStartOffset() const;
+    std::uint64_t getNextOffset() const;
+    std::size_t getSegmentCount() const;
+
+    // Assigns each message its offset; NO_OFFSET if the write failed
+    void append(Message* const* messages, std::size_t count);
+    std::size_t read(std::uint64_t offset, std::size_t maxMessages, std::vector<Message*>& out) const;
+    std::uint64_t findOffset(std::time_t timestamp) const; // first record at or after timestamp
+
+    bool commit(const std::string& consumerName, std::uint64_t offset);
+    std::uint64_t getCommitted(const std::string& consumerName) const; // start offset if never committed
+
+    void applyRetention();
+    void sync();
+
+    static std::string escapeName(std::string_view name);
+};
+
+#endif